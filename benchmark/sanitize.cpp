@@ -0,0 +1,76 @@
+/**
+ * sanitize.cpp
+ * Throughput of Logger::sanitize compared to a copy of the same messages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "blet/logger.h"
+
+static double s_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void s_copy(std::string& buffer, const char* str, std::size_t size) {
+    buffer.append(str, size);
+}
+
+/**
+ * @brief Render all messages in a reused buffer like the logger thread and print the bandwidth.
+ */
+static void s_bench(const char* name, void (*render)(std::string&, const char*, std::size_t),
+                    const std::vector<std::string>& messages, std::size_t iterations) {
+    std::string buffer;
+    buffer.reserve(1024 * 1024);
+    std::size_t bytes = 0;
+    std::size_t checksum = 0;
+    double start = s_now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        for (std::size_t j = 0; j < messages.size(); ++j) {
+            render(buffer, messages[j].data(), messages[j].size());
+            bytes += messages[j].size();
+            if (buffer.size() > 512 * 1024) {
+                checksum += buffer.size();
+                buffer.clear();
+            }
+        }
+    }
+    double elapsed = s_now() - start;
+    checksum += buffer.size();
+    printf("%-28s %8.2f GB/s %8.1f ns/message (%lu)\n", name, bytes / elapsed / 1e9,
+           elapsed * 1e9 / (iterations * messages.size()), static_cast<unsigned long>(checksum));
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t iterations = (argc > 1) ? static_cast<std::size_t>(atol(argv[1])) : 20000;
+    const char* text = "GET /api/v1/users/42/orders?limit=100 200 12.5ms user-agent=curl/8.5.0 request-id=1f3a9c";
+
+    std::vector<std::string> clean;
+    std::vector<std::string> newline;
+    std::vector<std::string> utf8;
+    std::vector<std::string> control;
+    for (std::size_t i = 0; i < 100; ++i) {
+        std::string message(text, strlen(text) - i % 32);
+        clean.push_back(message);
+        newline.push_back(message + "\n");
+        utf8.push_back(message + " caf\xc3\xa9 \xe2\x82\xac");
+        std::string escaped(message);
+        escaped[i % escaped.size()] = '\x1b';
+        control.push_back(escaped);
+    }
+
+    s_bench("copy clean", &s_copy, clean, iterations);
+    s_bench("sanitize clean", &blet::Logger::sanitize, clean, iterations);
+    s_bench("sanitize trailing newline", &blet::Logger::sanitize, newline, iterations);
+    s_bench("sanitize UTF-8", &blet::Logger::sanitize, utf8, iterations);
+    s_bench("sanitize control byte", &blet::Logger::sanitize, control, iterations);
+    return 0;
+}
@@ -27,13 +27,21 @@
 #define _BLET_LOGGER_H_
 
 #include <pthread.h>
-#include <semaphore.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <syslog.h>
 #include <time.h>
 
+#include <cstddef>
 #include <exception>
 #include <string>
+#include <vector>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
 
 #define LOGGER_FILENAME (const char*)(::strrchr(__FILE__, '/') + 1)
 #define LOGGER_MAIN() blet::Logger::getMain()
@@ -44,6 +52,20 @@
 #endif
 #endif
 
+#if __cplusplus >= 201103L
+#define _LOGGER_FORMAT(format, ...) format
+
+// arguments are formated by the logger thread if the format is a string literal
+#define LOGGER_ASYNC(logger, type, ...) \
+    ((void)sizeof(blet::Logger::checkFormat(__VA_ARGS__)), \
+     logger.deferredLog(type, \
+                        __FILE__, \
+                        LOGGER_FILENAME, \
+                        __LINE__, \
+                        __func__, \
+                        (__builtin_constant_p(_LOGGER_FORMAT(__VA_ARGS__, 0)) != 0), \
+                        ##__VA_ARGS__))
+#else
 #define LOGGER_ASYNC(logger, type, ...) \
     logger.asyncLog(type, \
                     __FILE__, \
@@ -51,6 +73,7 @@
                     __LINE__, \
                     __func__, \
                     ##__VA_ARGS__)
+#endif
 
 #define LOGGER_LOG(logger, type, ...) \
     logger.log(type, \
@@ -60,55 +83,180 @@
                __func__, \
                ##__VA_ARGS__)
 
+#if __cplusplus >= 201103L
+// message with key value fields formated by the logger thread, the message and the keys have to be string literals
+#define LOGGER_KV(logger, type, message, ...) \
+    logger.structuredLog(type, \
+                         __FILE__, \
+                         LOGGER_FILENAME, \
+                         __LINE__, \
+                         __func__, \
+                         "" message, \
+                         ##__VA_ARGS__)
+#endif
+
+#define _LOGGER_LOG_KV(logger, type, ...) ((logger).isLoggable(type) ? LOGGER_KV(logger, type, __VA_ARGS__) : (void)0)
+
+// arguments are not evaluated if level is disabled
 #ifdef LOGGER_SYNC
-#define _LOGGER_LOG(...) LOGGER_LOG(__VA_ARGS__)
+#define _LOGGER_LOG(logger, type, ...) \
+    ((logger).isLoggable(type) ? LOGGER_LOG(logger, type, __VA_ARGS__) : (void)0)
 #else
-#define _LOGGER_LOG(...) LOGGER_ASYNC(__VA_ARGS__)
+#define _LOGGER_LOG(logger, type, ...) \
+    ((logger).isLoggable(type) ? LOGGER_ASYNC(logger, type, __VA_ARGS__) : (void)0)
+#endif
+
+// messages less important than LOGGER_MIN_LEVEL are removed at compile time
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL LOG_DEBUG
 #endif
 
+#define _LOGGER_STRIPPED(...) ((void)0)
+
+#if LOGGER_MIN_LEVEL >= LOG_EMERG
 #define LOGGER_EMERG(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::EMERGENCY, __VA_ARGS__)
+#define LOGGER_TO_EMERG(logger, ...) _LOGGER_LOG(logger, blet::Logger::EMERGENCY, __VA_ARGS__)
+#define LOGGER_EMERG_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::EMERGENCY, __VA_ARGS__)
+#define LOGGER_TO_EMERG_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::EMERGENCY, __VA_ARGS__)
+#else
+#define LOGGER_EMERG(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_EMERG(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_EMERG_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_EMERG_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_ALERT
 #define LOGGER_ALERT(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::ALERT, __VA_ARGS__)
+#define LOGGER_TO_ALERT(logger, ...) _LOGGER_LOG(logger, blet::Logger::ALERT, __VA_ARGS__)
+#define LOGGER_ALERT_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::ALERT, __VA_ARGS__)
+#define LOGGER_TO_ALERT_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::ALERT, __VA_ARGS__)
+#else
+#define LOGGER_ALERT(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_ALERT(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_ALERT_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_ALERT_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_CRIT
 #define LOGGER_CRIT(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::CRITICAL, __VA_ARGS__)
+#define LOGGER_TO_CRIT(logger, ...) _LOGGER_LOG(logger, blet::Logger::CRITICAL, __VA_ARGS__)
+#define LOGGER_CRIT_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::CRITICAL, __VA_ARGS__)
+#define LOGGER_TO_CRIT_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::CRITICAL, __VA_ARGS__)
+#else
+#define LOGGER_CRIT(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_CRIT(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_CRIT_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_CRIT_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_ERR
 #define LOGGER_ERROR(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::ERROR, __VA_ARGS__)
+#define LOGGER_TO_ERR(logger, ...) _LOGGER_LOG(logger, blet::Logger::ERROR, __VA_ARGS__)
+#define LOGGER_ERROR_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::ERROR, __VA_ARGS__)
+#define LOGGER_TO_ERR_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::ERROR, __VA_ARGS__)
+#else
+#define LOGGER_ERROR(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_ERR(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_ERROR_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_ERR_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_WARNING
 #define LOGGER_WARN(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::WARNING, __VA_ARGS__)
+#define LOGGER_TO_WARN(logger, ...) _LOGGER_LOG(logger, blet::Logger::WARNING, __VA_ARGS__)
+#define LOGGER_WARN_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::WARNING, __VA_ARGS__)
+#define LOGGER_TO_WARN_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::WARNING, __VA_ARGS__)
+#else
+#define LOGGER_WARN(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_WARN(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_WARN_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_WARN_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_NOTICE
 #define LOGGER_NOTICE(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::NOTICE, __VA_ARGS__)
+#define LOGGER_TO_NOTICE(logger, ...) _LOGGER_LOG(logger, blet::Logger::NOTICE, __VA_ARGS__)
+#define LOGGER_NOTICE_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::NOTICE, __VA_ARGS__)
+#define LOGGER_TO_NOTICE_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::NOTICE, __VA_ARGS__)
+#else
+#define LOGGER_NOTICE(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_NOTICE(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_NOTICE_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_NOTICE_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
+
+#if LOGGER_MIN_LEVEL >= LOG_INFO
 #define LOGGER_INFO(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::INFO, __VA_ARGS__)
-#define LOGGER_DEBUG(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::DEBUG, __VA_ARGS__)
+#define LOGGER_TO_INFO(logger, ...) _LOGGER_LOG(logger, blet::Logger::INFO, __VA_ARGS__)
+#define LOGGER_INFO_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::INFO, __VA_ARGS__)
+#define LOGGER_TO_INFO_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::INFO, __VA_ARGS__)
+#else
+#define LOGGER_INFO(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_INFO(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_INFO_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_INFO_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
 
+#if LOGGER_MIN_LEVEL >= LOG_DEBUG
+#define LOGGER_DEBUG(...) _LOGGER_LOG(LOGGER_MAIN(), blet::Logger::DEBUG, __VA_ARGS__)
 #define LOGGER_TO_DEBUG(logger, ...) _LOGGER_LOG(logger, blet::Logger::DEBUG, __VA_ARGS__)
-#define LOGGER_TO_INFO(logger, ...) _LOGGER_LOG(logger, blet::Logger::INFO, __VA_ARGS__)
-#define LOGGER_TO_NOTICE(logger, ...) _LOGGER_LOG(logger, blet::Logger::NOTICE, __VA_ARGS__)
-#define LOGGER_TO_WARN(logger, ...) _LOGGER_LOG(logger, blet::Logger::WARNING, __VA_ARGS__)
-#define LOGGER_TO_ERR(logger, ...) _LOGGER_LOG(logger, blet::Logger::ERROR, __VA_ARGS__)
-#define LOGGER_TO_CRIT(logger, ...) _LOGGER_LOG(logger, blet::Logger::CRITICAL, __VA_ARGS__)
-#define LOGGER_TO_ALERT(logger, ...) _LOGGER_LOG(logger, blet::Logger::ALERT, __VA_ARGS__)
-#define LOGGER_TO_EMERG(logger, ...) _LOGGER_LOG(logger, blet::Logger::EMERGENCY, __VA_ARGS__)
+#define LOGGER_DEBUG_KV(...) _LOGGER_LOG_KV(LOGGER_MAIN(), blet::Logger::DEBUG, __VA_ARGS__)
+#define LOGGER_TO_DEBUG_KV(logger, ...) _LOGGER_LOG_KV(logger, blet::Logger::DEBUG, __VA_ARGS__)
+#else
+#define LOGGER_DEBUG(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_DEBUG(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#define LOGGER_DEBUG_KV(...) _LOGGER_STRIPPED(__VA_ARGS__)
+#define LOGGER_TO_DEBUG_KV(logger, ...) _LOGGER_STRIPPED(logger, __VA_ARGS__)
+#endif
 
 #define LOGGER_FLUSH() LOGGER_MAIN().flush()
 #define LOGGER_TO_FLUSH(logger) logger.flush()
 
+#define LOGGER_SET_LEVEL(level) LOGGER_MAIN().setLevel(level)
+#define LOGGER_TO_SET_LEVEL(logger, level) logger.setLevel(level)
+
 // OPTIONS
 
-#ifndef LOGGER_ASYNC_DROP_OVERFLOW
-#define LOGGER_ASYNC_WAIT_PRINT 1
-#endif
+// define LOGGER_ASYNC_DROP_OVERFLOW when building the library
+// to use DROP_NEWEST_OVERFLOW instead of BLOCK_OVERFLOW as default overflow policy
 
+// size in bytes of the queue of each producer thread (power of 2)
 #ifndef LOGGER_QUEUE_SIZE
-#define LOGGER_QUEUE_SIZE 256
+#define LOGGER_QUEUE_SIZE 65536
 #endif
 
+// bigger messages are allocated out of the queue
 #ifndef LOGGER_MESSAGE_MAX_SIZE
 #define LOGGER_MESSAGE_MAX_SIZE 2048
 #endif
 
-#ifndef LOGGER_MAX_LOG_THREAD_NB
-#define LOGGER_MAX_LOG_THREAD_NB 20
+// number of sched_yield of the logger thread or of a blocked producer before it is parked
+#ifndef LOGGER_WAKEUP_SPIN
+#define LOGGER_WAKEUP_SPIN 16
+#endif
+
+// rendered messages are written to the file by batch of this size
+#ifndef LOGGER_OUTPUT_BATCH_SIZE
+#define LOGGER_OUTPUT_BATCH_SIZE 1048576
+#endif
+
+// number of loggers written by the fatal signal handler (setCrashFlush)
+#ifndef LOGGER_CRASH_MAX_LOGGERS
+#define LOGGER_CRASH_MAX_LOGGERS 64
 #endif
 
+// first bytes of binary stream
+#define LOGGER_BINARY_MAGIC "BLETLOG1"
+
 #ifndef LOGGER_DEFAULT_FORMAT
 #define LOGGER_DEFAULT_FORMAT "[{pid}] {name:%-10s}:{level:%-6s}: {path}:{line} {message}"
 #endif
 
+// fields of addStructuredSink before the message and the key value fields
+#ifndef LOGGER_DEFAULT_STRUCTURED_FIELDS
+#define LOGGER_DEFAULT_STRUCTURED_FIELDS "{time:iso8601.6}{name}{level}{path}{line}{func}"
+#endif
+
 // name, level, path, file, line, func, pid, time, message, microsec, millisec, nanosec
 
 namespace blet {
@@ -142,6 +290,54 @@ class Logger {
         DEBUG = LOG_DEBUG
     };
 
+    /**
+     * @brief Clock of message timestamps.
+     * Raw clocks are converted to realtime by the logger thread.
+     */
+    enum eClock {
+        // CLOCK_REALTIME
+        REALTIME_CLOCK,
+        // CLOCK_REALTIME_COARSE, resolution of the scheduler tick
+        REALTIME_COARSE_CLOCK,
+        // CLOCK_MONOTONIC_RAW calibrated against CLOCK_REALTIME
+        MONOTONIC_RAW_CLOCK,
+        // time stamp counter calibrated against CLOCK_REALTIME
+        TSC_CLOCK
+    };
+
+    /**
+     * @brief Action of asyncLog when the queue of thread is full.
+     */
+    enum eOverflowPolicy {
+        // wait the logger thread
+        BLOCK_OVERFLOW,
+        // wait the logger thread until a timeout, then drop the new message
+        BLOCK_TIMEOUT_OVERFLOW,
+        // drop the new message
+        DROP_NEWEST_OVERFLOW,
+        // drop the oldest messages not taken by the logger thread
+        OVERWRITE_OLDEST_OVERFLOW
+    };
+
+    /**
+     * @brief Tags of the binary stream of addBinarySink.
+     */
+    enum eBinaryTag {
+        BINARY_NAME_TAG = 'N',
+        BINARY_SITE_TAG = 'S',
+        BINARY_MESSAGE_TAG = 'M'
+    };
+
+    /**
+     * @brief Encoding of addStructuredSink.
+     */
+    enum eStructuredFormat {
+        // one JSON object by line
+        JSON_STRUCTURED,
+        // key=value separated by space by line
+        LOGFMT_STRUCTURED
+    };
+
     struct Message {
         eLevel level;
         const char* file;
@@ -149,36 +345,733 @@ class Logger {
         int line;
         const char* function;
         struct timespec ts;
-        char message[LOGGER_MESSAGE_MAX_SIZE];
+        const char* message;
+    };
+
+    /**
+     * @brief Output of the rendered messages, used only by the logger thread.
+     */
+    class Sink {
+      public:
+        virtual ~Sink() {}
+
+        /**
+         * @brief Write a batch of rendered messages.
+         */
+        virtual void write(const char* data, std::size_t size) = 0;
+
+        /**
+         * @brief Called after the write of a flush request.
+         */
+        virtual void flush() {}
+
+        /**
+         * @brief Called after the write of durable messages, the written messages have to reach the disk.
+         */
+        virtual void sync() {
+            flush();
+        }
+
+        /**
+         * @brief Called by the logger thread before the render of each message when isIndexed is true.
+         * Only RotatingFileSink and MmapFileSink keep a FileIndex, FileSink and UringFileSink are not indexed.
+         *
+         * @param message
+         * @param offset position of the message in the data of the next write.
+         */
+        virtual void index(const Message& message, std::size_t offset) {
+            (void)message;
+            (void)offset;
+        }
+
+        /**
+         * @brief Read by addSink, the logger calls index only for the indexed sinks.
+         */
+        virtual bool isIndexed() const {
+            return false;
+        }
+
+        /**
+         * @brief Called by the logger thread after the render of each record of a binary stream (addBinarySink).
+         * A sink which starts a new file at offset returns true,
+         * the header of stream (magic, name and call sites) is written again at offset before the record.
+         *
+         * @param offset position of the record in the data of the next write.
+         * @param size size of the record.
+         * @return true if the next write starts a new file at offset.
+         */
+        virtual bool split(std::size_t offset, std::size_t size) {
+            (void)offset;
+            (void)size;
+            return false;
+        }
+    };
+
+    /**
+     * @brief Sidecar sparse index of a log file (path.idx).
+     * A block by blockSize bytes of messages keeps the time range and the levels of its messages,
+     * the completed blocks are written by the logger thread after the write of their messages.
+     */
+    class FileIndex {
+      public:
+        struct Block {
+            int64_t minStamp; // nanoseconds since epoch
+            int64_t maxStamp;
+            uint64_t offset;
+            uint64_t size;
+            uint32_t levels; // bit (1 << level) by level of message
+            uint32_t reserved;
+        };
+
+        /**
+         * @brief Open the index in append mode.
+         *
+         * @param path path of index.
+         * @param blockSize minimum size in bytes of messages by block.
+         * @param isTruncated remove the previous blocks.
+         * @throw Exception if the index can not be opened.
+         */
+        FileIndex(const char* path, std::size_t blockSize, bool isTruncated = false);
+        ~FileIndex();
+
+        /**
+         * @brief Add a message at offset of the log file.
+         */
+        void add(const Message& message, uint64_t offset);
+
+        /**
+         * @brief Write the completed blocks.
+         */
+        void write();
+
+        /**
+         * @brief Complete the current block at the end offset of the log file and write the blocks.
+         */
+        void finish(uint64_t end);
+
+        static std::string getPath(const std::string& path) {
+            return path + ".idx";
+        }
+
+        /**
+         * @brief Read all blocks of an index.
+         *
+         * @throw Exception if the index can not be read or is invalid.
+         */
+        static void read(const char* path, std::vector<Block>& blocks);
+
+        /**
+         * @brief Select the blocks with messages in [since, until] and a level lower or equal to level.
+         * The adjacent selected blocks are merged.
+         */
+        static void find(const std::vector<Block>& blocks, int64_t since, int64_t until, eLevel level,
+                         std::vector<Block>& found);
+
+      private:
+        FileIndex(const FileIndex&); // disable copy
+        FileIndex& operator=(const FileIndex&); // disable copy
+
+        std::size_t _blockSize;
+        int _fd;
+        bool _hasBlock;
+        Block _block;
+        std::vector<Block> _blocks;
     };
 
-    Logger();
+    /**
+     * @brief Write the messages on the descriptor of a FILE (not closed).
+     */
+    class FileSink: public Sink {
+      public:
+        FileSink(FILE* file = NULL);
+        virtual ~FileSink();
+
+        void setFILE(FILE* file) {
+            _file = file;
+        }
+
+        FILE* getFILE() const {
+            return _file;
+        }
+
+        virtual void write(const char* data, std::size_t size);
+        virtual void flush();
+        virtual void sync();
+
+      private:
+        FILE* _file;
+    };
+
+    /**
+     * @brief Write the messages in a file renamed by size or time.
+     * The rotation is done by the logger thread, the next file is opened before the rotation:
+     * path.next is renamed to path, path is renamed to path.1, path.1 to path.2, ...
+     */
+    class RotatingFileSink: public Sink {
+      public:
+        enum eRotation {
+            NO_ROTATION,
+            HOURLY_ROTATION,
+            DAILY_ROTATION
+        };
+
+        /**
+         * @brief Open the file in append mode.
+         *
+         * @param path
+         * @param maxSize maximum size in bytes of a file or 0 for no limit.
+         * @param rotation rotation at each local hour or day.
+         * @param maxFiles number of rotated files kept.
+         * @param indexBlockSize block size of the FileIndex (path.idx) renamed with its file or 0 for no index.
+         * @throw Exception if the file can not be opened.
+         */
+        RotatingFileSink(const char* path, std::size_t maxSize, eRotation rotation = NO_ROTATION,
+                         unsigned int maxFiles = 8, std::size_t indexBlockSize = 0);
+        virtual ~RotatingFileSink();
+
+        virtual void write(const char* data, std::size_t size);
+        virtual void sync();
+        virtual void index(const Message& message, std::size_t offset);
+        virtual bool split(std::size_t offset, std::size_t size);
+
+        virtual bool isIndexed() const {
+            return _indexBlockSize > 0;
+        }
+
+      private:
+        RotatingFileSink(const RotatingFileSink&); // disable copy
+        RotatingFileSink& operator=(const RotatingFileSink&); // disable copy
+
+        time_t _rotationTime(time_t now) const;
+        std::string _rotatedPath(unsigned int index) const;
+        void _rotate();
+
+        std::string _path;
+        std::string _nextPath;
+        std::size_t _maxSize;
+        eRotation _rotation;
+        unsigned int _maxFiles;
+        int _fd;
+        int _nextFd;
+        std::size_t _size;
+        time_t _nextRotation;
+        std::size_t _indexBlockSize;
+        FileIndex* _index;
+        // messages of the next write
+        std::vector<std::pair<std::size_t, Message> > _marks;
+        // binary stream rotated only at the offsets of split
+        bool _isSplit;
+        std::vector<std::size_t> _splits;
+    };
+
+    /**
+     * @brief Copy the messages in preallocated and mapped segments of file (path.0, path.1, ...).
+     * The logger thread writes without syscall, the pages behind the cursor are written back and released
+     * by window. A segment is truncated to its real length when it is full or at the destruction.
+     * Each segment may have its FileIndex (path.N.idx).
+     */
+    class MmapFileSink: public Sink {
+      public:
+        /**
+         * @brief Create the first segment not existing.
+         *
+         * @param path prefix of segments.
+         * @param segmentSize size of a segment in bytes.
+         * @param syncWindow size in bytes of msync and madvise(MADV_DONTNEED) or 0 for none.
+         * @param indexBlockSize block size of the FileIndex of each segment or 0 for no index.
+         * @throw Exception if the segment can not be created.
+         */
+        MmapFileSink(const char* path, std::size_t segmentSize = 64 * 1024 * 1024,
+                     std::size_t syncWindow = 1024 * 1024, std::size_t indexBlockSize = 0);
+        virtual ~MmapFileSink();
+
+        virtual void write(const char* data, std::size_t size);
+        virtual void flush();
+        virtual void sync();
+        virtual void index(const Message& message, std::size_t offset);
+        virtual bool split(std::size_t offset, std::size_t size);
+
+        virtual bool isIndexed() const {
+            return _indexBlockSize > 0;
+        }
+
+        /**
+         * @brief Get the path of the current segment.
+         */
+        std::string getPath() const {
+            return _segmentPath(_index);
+        }
+
+      private:
+        MmapFileSink(const MmapFileSink&); // disable copy
+        MmapFileSink& operator=(const MmapFileSink&); // disable copy
+
+        std::string _segmentPath(unsigned int index) const;
+        void _open(std::size_t size);
+        void _close();
+        void _sync(bool isAll);
+
+        std::string _path;
+        std::size_t _segmentSize;
+        std::size_t _syncWindow;
+        std::size_t _pageSize;
+        unsigned int _index;
+        int _fd;
+        char* _map;
+        std::size_t _mapSize;
+        std::size_t _cursor;
+        std::size_t _syncCursor;
+        std::size_t _indexBlockSize;
+        FileIndex* _fileIndex;
+        // messages of the next write
+        std::vector<std::pair<std::size_t, Message> > _marks;
+        // binary stream, a new segment only at the offsets of split
+        bool _isSplit;
+        std::vector<std::size_t> _splits;
+    };
+
+    /**
+     * @brief Write the messages in a file with io_uring.
+     * The batches are copied in registered buffers and written by the kernel while the logger thread
+     * renders the next batches. flush waits the writes, sync waits the writes and a fdatasync.
+     * Use write(2) if io_uring is not available at run time or if <linux/io_uring.h> is missing.
+     */
+    class UringFileSink: public Sink {
+      public:
+        /**
+         * @brief Open the file, the messages are written at its end.
+         *
+         * @param path
+         * @param queueDepth number of batches in flight or 0 for write(2).
+         * @param bufferSize size of a registered buffer.
+         * @throw Exception if the file can not be opened.
+         */
+        UringFileSink(const char* path, unsigned int queueDepth = 4,
+                      std::size_t bufferSize = LOGGER_OUTPUT_BATCH_SIZE);
+        virtual ~UringFileSink();
+
+        virtual void write(const char* data, std::size_t size);
+        virtual void flush();
+        virtual void sync();
+
+        bool isUring() const {
+            return _ringFd >= 0;
+        }
+
+      private:
+        UringFileSink(const UringFileSink&); // disable copy
+        UringFileSink& operator=(const UringFileSink&); // disable copy
+
+        struct Buffer {
+            Buffer() :
+                data(NULL),
+                capacity(0),
+                size(0),
+                written(0),
+                offset(0),
+                isBusy(false) {}
+
+            char* data;
+            std::size_t capacity;
+            std::size_t size;
+            std::size_t written;
+            uint64_t offset;
+            bool isBusy;
+        };
+
+        bool _setup(unsigned int queueDepth);
+        void _submitWrite(unsigned int index);
+        void _reap(bool isWaiting);
+
+        std::string _path;
+        int _fd;
+        uint64_t _offset;
+        std::vector<Buffer> _buffers;
+        int _ringFd;
+        void* _sqRing;
+        std::size_t _sqRingSize;
+        void* _cqRing;
+        std::size_t _cqRingSize;
+        void* _sqes;
+        std::size_t _sqesSize;
+        unsigned int _sqTail;
+        unsigned int _sqMask;
+        unsigned int _cqMask;
+        unsigned int* _sqTailPtr;
+        unsigned int* _sqArray;
+        unsigned int* _cqHeadPtr;
+        unsigned int* _cqTailPtr;
+        void* _cqes;
+        unsigned int _inFlight;
+    };
+
+    /**
+     * @brief Read the binary stream of addBinarySink.
+     */
+    class BinaryReader {
+      public:
+        BinaryReader(FILE* file);
+
+        /**
+         * @brief Read the next message, the strings of message are valid until the next call.
+         *
+         * @return false at the end of stream.
+         * @throw Exception if the stream is invalid.
+         */
+        bool next(Message& message);
+
+        /**
+         * @brief Get the name of logger of the last message.
+         */
+        const std::string& getName() const {
+            return _name;
+        }
+
+        /**
+         * @brief Get the position in file after the last message.
+         */
+        long getOffset() const {
+            return _offset;
+        }
+
+      private:
+        struct Site {
+            eLevel level;
+            bool isDeferred;
+            bool isStructured;
+            std::string file;
+            std::string filename;
+            int line;
+            std::string function;
+            std::string format;
+            std::string signature;
+        };
+
+        int _readByte();
+        uint64_t _readVarint();
+        void _readBytes(std::string& str);
+
+        FILE* _file;
+        bool _isHeaderRead;
+        long _offset;
+        std::string _name;
+        std::vector<Site> _sites;
+        int64_t _stamp;
+        std::string _payload;
+        std::string _message;
+    };
+
+  private:
+    /**
+     * @brief Lock-free single producer single consumer queue of messages.
+     * One ring is created by producer thread and drained by _threadLog.
+     */
+    struct Ring;
+
+  public:
+    /**
+     * @brief Logger threads shared by many loggers.
+     * A logger constructed with a backend has no thread, its messages are drained by a thread of the backend.
+     * The loggers are spread on the threads, a thread drains its loggers in turn.
+     * The rings of a producer thread are found by a thread specific key of the backend.
+     * The backend must outlive its loggers.
+     */
+    class Backend {
+      public:
+        /**
+         * @brief Start the threads.
+         *
+         * @param threadCount number of threads.
+         * @throw Exception if a thread can not be created.
+         */
+        explicit Backend(std::size_t threadCount = 1);
+        ~Backend();
+
+        std::size_t getThreadCount() const {
+            return _workers.size();
+        }
+
+        /**
+         * @brief Pin the threads on cpus.
+         *
+         * @param cpus indexes of cpus.
+         * @throw Exception if the affinity can not be set.
+         */
+        void setThreadAffinity(const std::vector<int>& cpus);
+
+        /**
+         * @brief Set the scheduling of the threads.
+         *
+         * @param policy SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR.
+         * @param priority nice value or realtime priority with SCHED_FIFO and SCHED_RR.
+         * @throw Exception if the scheduling can not be set.
+         */
+        void setThreadPriority(int policy, int priority);
+
+        /**
+         * @brief Set the name of the threads, the index of thread is appended when there are many threads.
+         *
+         * @param name truncated to 15 characters with the index.
+         * @throw Exception if the name can not be set.
+         */
+        void setThreadName(const char* name);
+
+      private:
+        Backend(const Backend&); // disable copy
+        Backend& operator=(const Backend&); // disable copy
+
+        friend class Logger;
+
+        /**
+         * @brief Thread of backend and its loggers.
+         */
+        struct Worker;
+
+        /**
+         * @brief Rings of a producer thread by id of logger.
+         */
+        struct ThreadRings;
+
+        void _stop();
+        static void* _threadWorker(void* e);
+        pid_t _threadTid(Worker* worker);
+        void _threadRun(Worker* worker);
+        bool _hasWork(Worker* worker);
+        void _waitWork(Worker* worker);
+        Worker* _attach(Logger* logger);
+        void _detach(Worker* worker, Logger* logger);
+        bool _isAttached(unsigned long loggerId) const;
+        Ring* _threadRing(unsigned long loggerId) const;
+        void _threadRingAdd(unsigned long loggerId, Ring* ring);
+        static void _threadRingsRelease(void* e);
+
+        std::vector<Worker*> _workers;
+        pthread_mutex_t _mutex;
+        // signaled at the start of a thread and after the detach of a logger
+        pthread_cond_t _condWorker;
+        // id of the next attached logger, protected by _mutex
+        unsigned long _nextLoggerId;
+        pthread_key_t _ringKey;
+        // rings of the producer threads, protected by _mutex
+        std::vector<ThreadRings*> _threadRings;
+    };
+
+    /**
+     * @brief Start a logger.
+     *
+     * @param backend shared threads of logger or NULL for a dedicated thread.
+     * @throw Exception if the thread can not be created.
+     */
+    explicit Logger(Backend* backend = NULL);
     ~Logger();
 
     static Logger& getMain() {
         static Logger logger;
-        logger.setName("main");
+        static bool isNamed = (logger.setName("main"), true);
+        (void)isNamed;
         return logger;
     }
 
-    void setName(const char* name_) {
-        name = name_;
-    }
+    /**
+     * @brief Set the name rendered in the formats.
+     */
+    void setName(const char* name_);
+
+    std::string getName() const;
 
+    /**
+     * @brief Wait the write of all messages enqueued before this call.
+     */
     void flush();
 
     /**
-     * @brief Set format of type
-     * {asctime}
-     * {filename}
-     * {funcname}
-     * {levelname}
-     * {lineno}
-     * {process}
-     * {message}
-     * {name}
-     * {pathname}
-     * {thread}
+     * @brief Wait the write of all messages enqueued before this call until a timeout.
+     *
+     * @param timeout nanoseconds to wait or negative value for no timeout.
+     * @return true if the messages are written.
+     */
+    bool flush(int64_t timeout);
+
+    /**
+     * @brief Function called by the logger thread when a flush ticket is written.
+     * The tickets before ticket are also written.
+     */
+    typedef void (*FlushCallback)(unsigned long ticket, void* userData);
+
+    /**
+     * @brief Request the write of all messages enqueued before this call without waiting.
+     * getFlushFd is readable and the flush callback is called when the ticket is written.
+     *
+     * @return ticket of isFlushed.
+     */
+    unsigned long flushAsync();
+
+    bool isFlushed(unsigned long ticket) const;
+
+    /**
+     * @brief Get the eventfd (non blocking) readable after the write of flushAsync tickets.
+     * Read the eventfd before the check of isFlushed.
+     * The eventfd is created at the first call and is readable once for the tickets written before.
+     *
+     * @throw Exception if the eventfd can not be created.
+     */
+    int getFlushFd() const;
+
+    /**
+     * @brief Set the function called by the logger thread after the write of flush tickets.
+     *
+     * @param callback NULL for no callback.
+     * @param userData argument of callback.
+     */
+    void setFlushCallback(FlushCallback callback, void* userData = NULL);
+
+    /**
+     * @brief Set the minimum level of LOGGER_* macros.
+     * Messages less important than level are ignored before the evaluation of their arguments.
+     *
+     * @param level default is DEBUG (all messages).
+     */
+    void setLevel(eLevel level) {
+        __atomic_store_n(&_level, static_cast<int>(level), __ATOMIC_RELAXED);
+    }
+
+    eLevel getLevel() const {
+        return static_cast<eLevel>(__atomic_load_n(&_level, __ATOMIC_RELAXED));
+    }
+
+    bool isLoggable(eLevel level) const {
+        return static_cast<int>(level) <= __atomic_load_n(&_level, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Set the clock of asyncLog timestamps.
+     * MONOTONIC_RAW_CLOCK and TSC_CLOCK are calibrated against CLOCK_REALTIME during this call,
+     * the logger thread keeps the calibration every second.
+     * log always use CLOCK_REALTIME or CLOCK_REALTIME_COARSE.
+     *
+     * @param clock default is REALTIME_CLOCK.
+     * @throw Exception if the time stamp counter is not invariant.
+     */
+    void setClock(eClock clock);
+
+    eClock getClock() const {
+        return static_cast<eClock>(__atomic_load_n(&_clock, __ATOMIC_RELAXED));
+    }
+
+    /**
+     * @brief Get the maximum error in nanoseconds of the timestamps converted to realtime.
+     */
+    int64_t getClockError() const;
+
+    /**
+     * @brief Set the action of asyncLog when the queue of thread is full.
+     * The dropped messages are counted by level,
+     * a "N messages dropped" line is printed before the next message of the thread.
+     *
+     * @param policy default is BLOCK_OVERFLOW (DROP_NEWEST_OVERFLOW with LOGGER_ASYNC_DROP_OVERFLOW).
+     * @param timeout nanoseconds to wait with BLOCK_TIMEOUT_OVERFLOW.
+     */
+    void setOverflowPolicy(eOverflowPolicy policy, int64_t timeout = 0);
+
+    eOverflowPolicy getOverflowPolicy() const {
+        return static_cast<eOverflowPolicy>(__atomic_load_n(&_overflowPolicy, __ATOMIC_RELAXED));
+    }
+
+    unsigned long getDroppedCount(eLevel level) const {
+        return __atomic_load_n(&_droppedCounts[level], __ATOMIC_RELAXED);
+    }
+
+    unsigned long getDroppedCount() const;
+
+    /**
+     * @brief Pin the logger thread on cpus.
+     * The threads of a Backend are set by Backend::setThreadAffinity.
+     *
+     * @param cpus indexes of cpus.
+     * @throw Exception if the affinity can not be set.
+     */
+    void setThreadAffinity(const std::vector<int>& cpus);
+
+    /**
+     * @brief Set the scheduling of the logger thread.
+     *
+     * @param policy SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR.
+     * @param priority nice value or realtime priority with SCHED_FIFO and SCHED_RR.
+     * @throw Exception if the scheduling can not be set.
+     */
+    void setThreadPriority(int policy, int priority);
+
+    /**
+     * @brief Set the name of the logger thread, visible in top -H and perf.
+     *
+     * @param name truncated to 15 characters.
+     * @throw Exception if the name can not be set.
+     */
+    void setThreadName(const char* name);
+
+    /**
+     * @brief Write the pending messages at a fatal signal (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT).
+     * The handler wakes the logger thread and waits its flush until timeout,
+     * the messages still in the queues are written on fd in a minimal format "name:LEVEL: path:line message"
+     * (the flags and width are ignored, the floating arguments have at most 9 decimals)
+     * and the signal is raised with its previous action.
+     * The handler only calls async-signal-safe functions. A message taken by a blocked logger thread is lost,
+     * a message queued behind it can be written twice if the logger thread resumes before the end of process.
+     *
+     * @param fd descriptor of the minimal messages or negative value to disable.
+     * @param timeout nanoseconds to wait the logger thread.
+     * @throw Exception if LOGGER_CRASH_MAX_LOGGERS loggers are already set.
+     */
+    void setCrashFlush(int fd, int64_t timeout = 100000000);
+
+    /**
+     * @brief Set the time waited by the logger thread after its wake up to print bigger batches.
+     * The threads of a Backend do not wait, they drain other loggers.
+     *
+     * @param microseconds default is 0.
+     */
+    void setBatchDelay(long microseconds) {
+        __atomic_store_n(&_batchDelay, microseconds, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Set the durability of a level.
+     * The logging of a durable message returns after the sync of sinks (fdatasync),
+     * the durable messages written in the same batch share the sync.
+     *
+     * @param level
+     * @param isDurable default is false for all levels.
+     */
+    void setDurable(eLevel level, bool isDurable);
+
+    /**
+     * @brief Escape the messages by the logger thread for the line oriented readers:
+     * \\ for the backslash, \n, \r, \t and \xHH for the other control bytes, DEL and the bytes of invalid
+     * UTF-8 sequences, so an escaped message can not be read as another.
+     *
+     * @param isSanitized default is false.
+     */
+    void setSanitize(bool isSanitized) {
+        __atomic_store_n(&_isSanitized, isSanitized, __ATOMIC_RELAXED);
+    }
+
+    bool isSanitized() const {
+        return __atomic_load_n(&_isSanitized, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Append str escaped like setSanitize.
+     * The bytes are checked by block of 32 (AVX2) or 16 (SSE2) and the clean blocks are copied.
+     */
+    static void sanitize(std::string& buffer, const char* str, std::size_t size);
+
+    bool isDurable(eLevel level) const {
+        return (__atomic_load_n(&_durableLevels, __ATOMIC_RELAXED) & (1 << level)) != 0;
+    }
+
+    /**
+     * @brief Set format of type.
+     * Same keywords of setAllFormat.
      *
      * @param level
      * @param format
@@ -195,29 +1088,130 @@ class Logger {
      * - line: __LINE__ of log
      * - func: __func__ of log
      * - pid: process id
-     * - time: datetime of log
+     * - time: local datetime of log
+     * - utctime: UTC datetime of log
      * - message: format message of log
      * - microsec: micro seconds
      * - millisec: milli seconds
      * - nanosec: nano seconds
+     * A keyword can have a printf specifier ({name:%-10s}, {line:%05d}) or a strftime format for time
+     * ({time:%Y-%m-%d %H:%M:%S}). The format is compiled once, name, level and pid are rendered at this time.
+     * The time can be rendered in ISO 8601 with optional fraction digits
+     * ({time:iso8601}, {utctime:iso8601.3}, {time:iso8601.9}).
      *
      * @param format C string of format.
      */
     void setAllFormat(const char* format);
 
+    /**
+     * @brief Set the FILE of the default sink.
+     *
+     * @param file default is stdout, NULL for no default output.
+     */
     void setFILE(FILE* file);
 
+    /**
+     * @brief Add an output of the logger thread, the sink is not deleted by the logger.
+     * The messages are rendered once by distinct format.
+     *
+     * @param sink
+     * @param level messages less important than level are not written in sink.
+     * @param format format of sink (same keywords of setAllFormat) or NULL for the formats of logger.
+     */
+    void addSink(Sink* sink, eLevel level = DEBUG, const char* format = NULL);
+
+    /**
+     * @brief Add a sink of compact binary stream, the messages are not formated by the logger thread.
+     * The stream starts by LOGGER_BINARY_MAGIC followed by records of a tag and varint or bytes fields:
+     * - BINARY_NAME_TAG: name of logger
+     * - BINARY_SITE_TAG: id, level, payload type (text, deferred, structured), path, filename, line, function,
+     *   format, argument types once by call site
+     * - BINARY_MESSAGE_TAG: id of site, zigzag delta of timestamp in nanoseconds, payload
+     * The payload is the raw deferred arguments (native byte order) or the formated message.
+     * A binary sink is used by only one logger, the stream is decoded by BinaryReader (blet-logcat).
+     * Each file of a sink which splits its output (Sink::split) starts by the magic, the name and all call sites.
+     */
+    void addBinarySink(Sink* sink, eLevel level = DEBUG);
+
+    /**
+     * @brief Add a sink of structured messages, a line by message:
+     * the fields, "message" and the key value fields of LOGGER_*_KV.
+     * The integers, floating and boolean values are not quoted.
+     *
+     * @param sink
+     * @param level
+     * @param encoding JSON_STRUCTURED or LOGFMT_STRUCTURED.
+     * @param fields keywords of setAllFormat ("{time:iso8601.3}{level}{line}"), the keyword is the key of field.
+     */
+    void addStructuredSink(Sink* sink, eLevel level = DEBUG, eStructuredFormat encoding = JSON_STRUCTURED,
+                           const char* fields = LOGGER_DEFAULT_STRUCTURED_FIELDS);
+
+    /**
+     * @brief Remove a sink, the sink is not used by the logger thread after this call.
+     */
+    void removeSink(Sink* sink);
+
     __attribute__((__format__(__printf__, 7, 8))) void asyncLog(eLevel level, const char* file, const char* filename,
                                                                 int line, const char* function,
                                                                 const char* format, ...);
 
+    /**
+     * @brief Write a message with all sinks and wait its write (LOGGER_SYNC).
+     * The message is formated by the caller and written by the logger thread like asyncLog,
+     * log can not be called from a sink.
+     */
     __attribute__((__format__(__printf__, 7, 8))) void log(eLevel level, const char* file, const char* filename,
                                                            int line, const char* function, const char* format,
                                                            ...);
 
-    void printMessage(Message& message) const;
+    /**
+     * @brief Never defined, only used in sizeof for check the format of deferredLog.
+     */
+    __attribute__((__format__(__printf__, 1, 2))) static int checkFormat(const char* format, ...);
+
+#if __cplusplus >= 201103L
+    /**
+     * @brief Copy the arguments in the queue, the message is formated by the logger thread.
+     * The format is read by the logger thread, C strings arguments are copied.
+     * If format is not a string literal, the message is formated by asyncLog.
+     *
+     * @param isLiteral format is a string literal (__builtin_constant_p), an array on the stack is not.
+     */
+    template<typename F, typename... Args>
+    void deferredLog(eLevel level, const char* file, const char* filename, int line, const char* function,
+                     bool isLiteral, const F& format, const Args&... args) {
+        if (isLiteral) {
+            _deferredLog(std::is_array<F>(), level, file, filename, line, function, format, args...);
+        }
+        else {
+            asyncLog(level, file, filename, line, function, format, args...);
+        }
+    }
+
+    /**
+     * @brief Copy the key value fields in the queue, the fields are encoded by the logger thread.
+     * The text sinks print the message followed by the fields in logfmt.
+     */
+    template<typename M, typename... Fields>
+    void structuredLog(eLevel level, const char* file, const char* filename, int line, const char* function,
+                       const M& message, const Fields&... fields) {
+        // LOGGER_KV rejects an array on the stack
+        static_assert(std::is_array<M>::value, "the message have to be a string literal");
+        static_assert(sizeof...(Fields) % 2 == 0, "a key without value");
+        static_assert(StructuredKeys<Fields...>::value, "a key is not a string");
+        Ring* ring;
+        Record* record;
+        static const char signature[] = {DeferredArg<typename std::decay<Fields>::type>::code..., '\0'};
+        char* payload = _asyncBegin(level, file, filename, line, function, message, &_renderStructured, signature,
+                                    DeferredArgs<Fields...>::size(fields...), &ring, &record);
+        if (payload != NULL) {
+            DeferredArgs<Fields...>::encode(payload, fields...);
+            _asyncCommit(ring, record);
+        }
+    }
+#endif
 
-    std::string name;
+    void printMessage(Message& message) const;
 
   private:
     Logger(const Logger&){}; // disable copy
@@ -225,56 +1219,309 @@ class Logger {
         return *this;
     }; // disable copy
 
+    /**
+     * @brief Header of a variable length message in a Ring.
+     */
+    struct Record;
+
+    /**
+     * @brief Format a message from the arguments copied in a record.
+     */
+    typedef int (*RenderFunction)(char* buffer, std::size_t size, const char* format, const char* args);
+
     static void* _threadLogger(void* e);
+    pid_t _threadTid();
+    static void _threadRingRelease(void* ring);
     void _threadLog();
+    void _threadWork();
+    Ring* _ringRegister();
+    void _wakeUp(bool isRequested);
+    bool _hasWork();
+    void _waitWork();
+    void _ringsDrain();
+    bool _ringHead(Ring* ring, int64_t& stamp);
+    void _render(Record* record);
+
+    /**
+     * @brief Sink and its formats.
+     */
+    struct SinkEntry;
+
+    void _sinksUpdate();
+    void _sinksRender(Message& message, Record* record);
+    void _binaryRender(SinkEntry& entry, const Message& message, const Record* record);
+    void _binaryRecord(SinkEntry& entry, const Message& message, const Record* record);
+    void _structuredRender(SinkEntry& entry, const Message& message, const Record* record);
+
+    /**
+     * @brief Render function of structured records, the fields are encoded by _render.
+     */
+    static int _renderStructured(char* buffer, std::size_t size, const char* format, const char* args);
+    void _sinksWrite();
+    void _sinksFlush();
+    void _sinksSync();
+    void _syncWait();
+    char* _asyncBegin(eLevel level, const char* file, const char* filename, int line, const char* function,
+                      const char* format, RenderFunction render, const char* signature, std::size_t payloadSize,
+                      Ring** ring, Record** record);
+    void _asyncCommit(Ring* ring, Record* record);
+    void _asyncVLog(eLevel level, const char* file, const char* filename, int line, const char* function,
+                    const char* format, va_list vargs);
+
+    /**
+     * @brief Loggers of the fatal signal handler and the previous signal actions.
+     */
+    struct CrashState;
+
+    static CrashState& _crashState();
+    static void _crashHandler(int sig);
+    void _crashUnregister();
+    void _crashWrite();
+    void _crashAppendRecord(char* buffer, std::size_t& size, const Record* record);
+
+#if __cplusplus >= 201103L
+    template<typename T, typename Enable = void>
+    struct DeferredArg;
+
+    template<typename... Args>
+    struct DeferredArgs;
+
+    template<typename... Fields>
+    struct StructuredKeys;
+
+    template<typename F, typename... Args>
+    void _deferredLog(std::true_type /* isArray */, eLevel level, const char* file, const char* filename, int line,
+                      const char* function, const F& format, const Args&... args) {
+        Ring* ring;
+        Record* record;
+        static const char signature[] = {DeferredArg<typename std::decay<Args>::type>::code..., '\0'};
+        char* payload = _asyncBegin(level, file, filename, line, function, format, &DeferredArgs<Args...>::render,
+                                    signature, DeferredArgs<Args...>::size(args...), &ring, &record);
+        if (payload != NULL) {
+            DeferredArgs<Args...>::encode(payload, args...);
+            _asyncCommit(ring, record);
+        }
+    }
+
+    template<typename F, typename... Args>
+    void _deferredLog(std::false_type /* isArray */, eLevel level, const char* file, const char* filename, int line,
+                      const char* function, const F& format, const Args&... args) {
+        asyncLog(level, file, filename, line, function, format, args...);
+    }
+#endif
+
+    /**
+     * @brief Linear conversion of a raw clock to realtime.
+     */
+    struct ClockCalibration {
+        ClockCalibration() :
+            generation(0),
+            rawStart(0),
+            realStart(0),
+            rawBase(0),
+            realBase(0),
+            nsecPerTick(1.0),
+            error(0),
+            lastCalibration(0) {}
+
+        unsigned long generation;
+        uint64_t rawStart;
+        int64_t realStart;
+        uint64_t rawBase;
+        int64_t realBase;
+        double nsecPerTick;
+        int64_t error;
+        int64_t lastCalibration;
+    };
+
+    static uint64_t _clockNow(eClock clock);
+    static void _clockSample(eClock clock, int64_t& real, uint64_t& raw, int64_t& error);
+    static ClockCalibration _clockCalibrate(eClock clock);
+    void _clockRecalibrate();
+    int64_t _clockToRealtime(eClock clock, uint64_t stamp) const;
 
     bool _isStarted;
+    int _level;
+    int _clock;
+    int _overflowPolicy;
+    int64_t _overflowTimeout;
+    long _batchDelay;
+    // futex of the parked logger thread
+    int _isSleeping;
+    // shared thread of logger or NULL
+    Backend* _backend;
+    Backend::Worker* _worker;
+    // id of logger in _backend, the rings of a thread are found by this id
+    unsigned long _backendId;
+    bool _isWakeRequested;
+    unsigned long _droppedCounts[LOG_DEBUG + 1];
+    // published by setClock, protected by _logMutex
+    ClockCalibration _clockCalibration;
+    // used by the logger thread
+    ClockCalibration _threadClockCalibration;
     pthread_mutex_t _logMutex;
     pthread_cond_t _condLog;
-    sem_t _queueSemaphore;
     pthread_t _threadLogId;
-    unsigned int _currentMessageId;
+    // kernel id of the logger thread, protected by _logMutex
+    pid_t _threadLogTid;
+    // rings of the producer threads without backend
+    pthread_key_t _ringKey;
+    Ring* _rings;
+    // last flush request
+    unsigned long _flushSequence;
+    // last flush request written by the logger thread, protected by _logMutex
+    unsigned long _writtenSequence;
+    // created by getFlushFd or -1
+    int _flushFd;
+    FlushCallback _flushCallback;
+    void* _flushUserData;
+    // descriptor and timeout of setCrashFlush
+    int _crashFd;
+    int64_t _crashTimeout;
+    // flush ticket requested by the fatal signal handler
+    unsigned long _crashTicket;
+    // mask of durable levels
+    int _durableLevels;
+    bool _isSanitized;
+    // last sync request
+    unsigned long _syncSequence;
+    // last sync request done by the logger thread, protected by _logMutex
+    unsigned long _syncedSequence;
 
-    FILE* _pfile;
-    Message* _messages;
-    Message* _messagesSwap;
+    // rendered in the formats, protected by _logMutex
+    std::string _name;
+    // used by the logger thread
+    std::string _threadName;
+
+    FileSink _fileSink;
+    // protected by _logMutex, ordered by format
+    std::vector<SinkEntry*> _sinks;
+    unsigned long _sinksGeneration;
+    // used by the logger thread
+    std::vector<SinkEntry*> _threadSinks;
+    unsigned long _threadSinksGeneration;
+    std::size_t _sinksBufferSize;
+    // min heap of the next stamp of the rings, used by the logger thread
+    std::vector<std::pair<int64_t, Ring*> > _drainHeap;
+    std::string _renderBuffer;
+    std::string _outputBuffer;
+    std::string _structuredMessage;
+    std::string _fieldBuffer;
 
     // format options
     struct Format {
+        /**
+         * @brief Last rendered time of a TIME operation.
+         * The date is rendered once by minute, the seconds are patched, the UTC offset is kept by quarter hour.
+         */
+        struct TimeCache {
+            TimeCache() :
+                isSecondValid(false),
+                second(0),
+                rendered(""),
+                isMinuteValid(false),
+                minute(0),
+                minuteRendered(""),
+                offsetStart(0),
+                offsetEnd(0),
+                offset(0),
+                zone(NULL),
+                isDst(0),
+                isoOffset("") {}
+
+            bool isSecondValid;
+            time_t second;
+            std::string rendered;
+            bool isMinuteValid;
+            time_t minute;
+            std::string minuteRendered;
+            std::vector<std::size_t> secondIndexes;
+            time_t offsetStart;
+            time_t offsetEnd;
+            long offset;
+            const char* zone;
+            int isDst;
+            std::string isoOffset;
+        };
+
+        /**
+         * @brief Render operation of a compiled format.
+         */
+        struct Operation {
+            enum eType {
+                LITERAL,
+                PATH,
+                FILENAME,
+                LINE,
+                FUNCTION,
+                TIME,
+                MESSAGE,
+                DECIMAL
+            };
+
+            Operation(eType type_) :
+                type(type_),
+                isLeftAlign(false),
+                padding(' '),
+                sign('\0'),
+                width(0),
+                precision(-1),
+                conversion('\0'),
+                nsecDivisor(1),
+                str(""),
+                printfFormat(""),
+                isUtc(false),
+                isIso8601(false),
+                isPatchable(false),
+                patchFormat("") {}
+
+            eType type;
+            // printf like specifier of field
+            bool isLeftAlign;
+            char padding;
+            char sign;
+            int width;
+            int precision;
+            char conversion;
+            // divisor of nanoseconds for DECIMAL
+            long nsecDivisor;
+            // text of LITERAL or strftime format of TIME
+            std::string str;
+            // used when the conversion is not rendered by the logger
+            std::string printfFormat;
+            // options of TIME
+            bool isUtc;
+            bool isIso8601;
+            bool isPatchable;
+            std::string patchFormat;
+            // only used by the logger thread
+            mutable TimeCache timeCache;
+        };
+
         Format() :
-        hasTime(false),
-        hasLine(false),
-        hasPid(false),
-        hasThread(false),
-        hasMicroSec(false),
-        hasMilliSec(false),
-        hasNanoSec(false),
-        time(""),
-        pid(0),
-        threadId(0),
-        nsecDivisor(1),
-        str(""),
-        origin("") {}
-
-        bool hasTime;
-        bool hasLine;
-        bool hasPid;
-        bool hasThread;
-        bool hasMicroSec;
-        bool hasMilliSec;
-        bool hasNanoSec;
-
-        std::string time;
-        pid_t pid;
-        pthread_t threadId;
-        int nsecDivisor;
-
-        std::string str;
+            origin("") {}
+
+        std::vector<Operation> operations;
         std::string origin;
     };
 
-    static Format _formatContructor(const char* format);
-    Format _format;
+    static Format _formatContructor(const char* format, const std::string& name, eLevel level);
+    static void _parseSpecifier(const std::string& specifier, Format::Operation& operation, std::string& prefix,
+                                std::string& suffix);
+    static void _appendLiteral(Format& format, const std::string& literal);
+    static void _appendString(std::string& buffer, const Format::Operation& operation, const char* str,
+                              bool isSanitized = false);
+    static void _appendInteger(std::string& buffer, const Format::Operation& operation, long value);
+    static void _compileTime(Format::Operation& operation, const std::string& specifier);
+    static void _appendTime(std::string& buffer, const Format::Operation& operation, const struct timespec& ts,
+                            Format::TimeCache& cache);
+    static const char* _levelName(eLevel level);
+    Format* _levelFormat(eLevel level);
+    const Format* _levelFormat(eLevel level) const;
+    void _renderMessage(std::string& buffer, const Message& message, bool isCached) const;
+    static void _renderMessage(std::string& buffer, const Format& format, const Message& message, bool isCached,
+                               bool isSanitized);
+
     Format _emergencyFormat;
     Format _alertFormat;
     Format _criticalFormat;
@@ -283,6 +1530,8 @@ class Logger {
     Format _noticeFormat;
     Format _infoFormat;
     Format _debugFormat;
+    // formats by level used by the logger thread, copied by _sinksUpdate
+    Format _threadFormats[LOG_DEBUG + 1];
 
 #ifdef LOGGER_PERF_DEBUG
     ::timespec _startTs;
@@ -291,6 +1540,164 @@ class Logger {
 #endif
 };
 
+#if __cplusplus >= 201103L
+
+// integer, enum and floating arguments
+template<typename T>
+struct Logger::DeferredArg<T, typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type> {
+    typedef T Type;
+
+    // type in the binary stream: b, h, i, l (signed 1, 2, 4, 8 bytes), B, H, I, L (unsigned), f, d, D (floating),
+    // t (bool)
+    static constexpr char code =
+        std::is_same<T, bool>::value
+            ? 't'
+            : (std::is_floating_point<T>::value
+                   ? (sizeof(T) == sizeof(float) ? 'f' : (sizeof(T) == sizeof(double) ? 'd' : 'D'))
+                   : static_cast<char>(
+                         (sizeof(T) == 1 ? 'b' : (sizeof(T) == 2 ? 'h' : (sizeof(T) == 4 ? 'i' : 'l'))) -
+                         (std::is_signed<T>::value ? 0 : 'a' - 'A')));
+
+    static std::size_t size(const T&) {
+        return sizeof(T);
+    }
+
+    static char* encode(char* payload, const T& value) {
+        ::memcpy(payload, &value, sizeof(T));
+        return payload + sizeof(T);
+    }
+
+    static const char* decode(const char* payload, Type& value) {
+        ::memcpy(&value, payload, sizeof(T));
+        return payload + sizeof(T);
+    }
+};
+
+// C string arguments are copied with a null flag
+template<typename T>
+struct Logger::DeferredArg<
+    T, typename std::enable_if<std::is_same<T, const char*>::value || std::is_same<T, char*>::value>::type> {
+    typedef const char* Type;
+
+    static constexpr char code = 's';
+
+    static std::size_t size(const char* value) {
+        return (value == NULL) ? 1 : ::strlen(value) + 2;
+    }
+
+    static char* encode(char* payload, const char* value) {
+        if (value == NULL) {
+            *payload = '\0';
+            return payload + 1;
+        }
+        *payload = '\1';
+        std::size_t size = ::strlen(value) + 1;
+        ::memcpy(payload + 1, value, size);
+        return payload + 1 + size;
+    }
+
+    static const char* decode(const char* payload, Type& value) {
+        if (*payload == '\0') {
+            value = NULL;
+            return payload + 1;
+        }
+        value = payload + 1;
+        return value + ::strlen(value) + 1;
+    }
+};
+
+// other pointers are copied by address
+template<typename T>
+struct Logger::DeferredArg<T, typename std::enable_if<(std::is_pointer<T>::value &&
+                                                       !std::is_same<T, const char*>::value &&
+                                                       !std::is_same<T, char*>::value) ||
+                                                      std::is_same<T, std::nullptr_t>::value>::type> {
+    typedef const void* Type;
+
+    static constexpr char code = 'p';
+
+    static std::size_t size(const T&) {
+        return sizeof(Type);
+    }
+
+    static char* encode(char* payload, const T& value) {
+        Type pointer = value;
+        ::memcpy(payload, &pointer, sizeof(Type));
+        return payload + sizeof(Type);
+    }
+
+    static const char* decode(const char* payload, Type& value) {
+        ::memcpy(&value, payload, sizeof(Type));
+        return payload + sizeof(Type);
+    }
+};
+
+template<>
+struct Logger::DeferredArgs<> {
+    static std::size_t size() {
+        return 0;
+    }
+
+    static char* encode(char* payload) {
+        return payload;
+    }
+
+    static int render(char* buffer, std::size_t size, const char* format, const char* payload) {
+        return unpack(buffer, size, format, payload);
+    }
+
+    template<typename... Decoded>
+    static int unpack(char* buffer, std::size_t size, const char* format, const char* /*payload*/,
+                      const Decoded&... decoded) {
+        // last argument avoid the warning of format without arguments
+        return ::snprintf(buffer, size, format, decoded..., 0);
+    }
+};
+
+template<typename T, typename... Args>
+struct Logger::DeferredArgs<T, Args...> {
+    typedef DeferredArg<typename std::decay<T>::type> Arg;
+
+    static std::size_t size(const T& arg, const Args&... args) {
+        return Arg::size(arg) + DeferredArgs<Args...>::size(args...);
+    }
+
+    static char* encode(char* payload, const T& arg, const Args&... args) {
+        return DeferredArgs<Args...>::encode(Arg::encode(payload, arg), args...);
+    }
+
+    static int render(char* buffer, std::size_t size, const char* format, const char* payload) {
+        return unpack(buffer, size, format, payload);
+    }
+
+    template<typename... Decoded>
+    static int unpack(char* buffer, std::size_t size, const char* format, const char* payload,
+                      const Decoded&... decoded) {
+        typename Arg::Type value;
+        payload = Arg::decode(payload, value);
+        return DeferredArgs<Args...>::unpack(buffer, size, format, payload, decoded..., value);
+    }
+};
+
+// the keys of structuredLog are C strings
+template<>
+struct Logger::StructuredKeys<> {
+    static constexpr bool value = true;
+};
+
+template<typename K, typename V, typename... Fields>
+struct Logger::StructuredKeys<K, V, Fields...> {
+    static constexpr bool value =
+        std::is_convertible<const K&, const char*>::value && StructuredKeys<Fields...>::value;
+};
+
+template<typename K>
+struct Logger::StructuredKeys<K> {
+    static constexpr bool value = false;
+};
+
+#endif
+
 } // namespace blet
 
 #endif // #ifndef _BLET_LOGGER_H_
\ No newline at end of file
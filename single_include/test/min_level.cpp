@@ -0,0 +1,39 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#define LOGGER_MIN_LEVEL LOG_WARNING
+#include "blet/logger.h"
+
+static std::size_t countInExecutable(const std::string& str) {
+    std::ifstream ifs("/proc/self/exe", std::ios::binary);
+    std::string executable((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::size_t count = 0;
+    std::size_t index = executable.find(str);
+    while (index != std::string::npos) {
+        ++count;
+        index = executable.find(str, index + 1);
+    }
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+
+    blet::Logger logger;
+    LOGGER_TO_INFO(logger, "SINGLE_INCLUDE_INFO_%d", 42);
+    LOGGER_TO_WARN(logger, "SINGLE_INCLUDE_WARN_%d", 42);
+    LOGGER_TO_FLUSH(logger);
+
+    // build the searched strings at runtime
+    std::string infoFormat("_INGLE_INCLUDE_INFO_%d");
+    std::string warnFormat("_INGLE_INCLUDE_WARN_%d");
+    infoFormat[0] = 'S';
+    warnFormat[0] = 'S';
+    if (countInExecutable(infoFormat) != 0 || countInExecutable(warnFormat) != 1) {
+        std::cerr << "LOGGER_MIN_LEVEL does not strip the messages" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -27,196 +27,3956 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <float.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
 #include <string.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
-#include <iostream>
-#include <list>
+// UringFileSink uses write(2) without the io_uring headers
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup)
+#define LOGGER_URING
+#endif
+#endif
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+// AVX2 is selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LOGGER_SANITIZE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <string>
+#include <vector>
+
+#define LOGGER_CACHE_LINE_SIZE 64
+#define LOGGER_RECORD_ALIGN    8
+
+// stack buffer of the fatal signal handler
+#define LOGGER_CRASH_BUFFER_SIZE 1024
+
+#define LOGGER_OPEN_BRACE  static_cast<char>(-41)
+#define LOGGER_SEPARATOR   static_cast<char>(-42)
+#define LOGGER_CLOSE_BRACE static_cast<char>(-43)
+
+namespace blet {
+
+// check the biggest record can be stored in a ring
+typedef char LoggerQueueSizeIsPowerOf2[(LOGGER_QUEUE_SIZE & (LOGGER_QUEUE_SIZE - 1)) == 0 ? 1 : -1];
+typedef char LoggerQueueSizeIsTooSmall[LOGGER_QUEUE_SIZE >= 4 * (LOGGER_MESSAGE_MAX_SIZE + 128) ? 1 : -1];
+
+struct Logger::Record {
+    // only size and isPadding are set in a padding record
+    unsigned int size;
+    bool isPadding;
+    char* outOfLine;
+    // messages dropped before this one in the ring
+    unsigned long dropped;
+    // raw timestamp of clock
+    uint64_t stamp;
+    eClock clock;
+    // format the arguments copied after the record or NULL if message is already formated
+    RenderFunction render;
+    // types of deferred arguments (DeferredArg::code)
+    const char* signature;
+    unsigned int payloadSize;
+    const char* format;
+    Message message;
+
+    static unsigned int alignSize(std::size_t size) {
+        return static_cast<unsigned int>((size + LOGGER_RECORD_ALIGN - 1) & ~(LOGGER_RECORD_ALIGN - 1));
+    }
+};
+
+struct Logger::Ring {
+    Ring() :
+        head(0),
+        tailCache(0),
+        dropped(0),
+        publishedHead(0),
+        cursor(0),
+        isProducerWaiting(0),
+        tail(0),
+        drainHead(0),
+        isReleased(false),
+        next(NULL),
+        buffer(new char[LOGGER_QUEUE_SIZE]) {}
+
+    ~Ring() {
+        // delete the out of line messages not printed
+        tail = cursorTail(cursor);
+        while (tail != publishedHead) {
+            Record* record = at(tail);
+            if (!record->isPadding) {
+                delete[] record->outOfLine;
+            }
+            tail += record->size;
+        }
+        delete[] buffer;
+    }
+
+    Record* at(unsigned int index) {
+        return reinterpret_cast<Record*>(buffer + (index & (LOGGER_QUEUE_SIZE - 1)));
+    }
+
+    static uint64_t makeCursor(unsigned int tail_, unsigned int drainHead_) {
+        return (static_cast<uint64_t>(drainHead_) << 32) | tail_;
+    }
+
+    static unsigned int cursorTail(uint64_t cursor_) {
+        return static_cast<unsigned int>(cursor_);
+    }
+
+    static unsigned int cursorDrainHead(uint64_t cursor_) {
+        return static_cast<unsigned int>(cursor_ >> 32);
+    }
+
+    /**
+     * @brief Reserve a record at the head of ring (producer side).
+     *
+     * @param size aligned size of record.
+     * @param policy action when the ring is full.
+     * @param timeout nanoseconds to wait with BLOCK_TIMEOUT_OVERFLOW.
+     * @param droppedCounts counters by level of dropped messages.
+     * @return new record or NULL if the new message is dropped.
+     */
+    Record* reserve(unsigned int size, eOverflowPolicy policy, int64_t timeout, unsigned long* droppedCounts) {
+        unsigned int index = head & (LOGGER_QUEUE_SIZE - 1);
+        // a record can not be split at the end of buffer
+        unsigned int padding = 0;
+        if (index + size > LOGGER_QUEUE_SIZE) {
+            padding = LOGGER_QUEUE_SIZE - index;
+        }
+        if (LOGGER_QUEUE_SIZE - (head - tailCache) < padding + size) {
+            tailCache = cursorTail(__atomic_load_n(&cursor, __ATOMIC_ACQUIRE));
+            struct timespec deadline = {0, 0};
+            if (policy == BLOCK_TIMEOUT_OVERFLOW) {
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec += static_cast<time_t>(timeout / 1000000000);
+                deadline.tv_nsec += static_cast<long>(timeout % 1000000000);
+                if (deadline.tv_nsec >= 1000000000) {
+                    deadline.tv_nsec -= 1000000000;
+                    ++deadline.tv_sec;
+                }
+            }
+            int spin = 0;
+            while (LOGGER_QUEUE_SIZE - (head - tailCache) < padding + size) {
+                if (policy == DROP_NEWEST_OVERFLOW) {
+                    return NULL;
+                }
+                struct timespec* remaining = NULL;
+                struct timespec now;
+                if (policy == BLOCK_TIMEOUT_OVERFLOW) {
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (now.tv_sec > deadline.tv_sec ||
+                        (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+                        return NULL;
+                    }
+                    // relative timeout of futex
+                    now.tv_sec = deadline.tv_sec - now.tv_sec;
+                    now.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+                    if (now.tv_nsec < 0) {
+                        now.tv_nsec += 1000000000;
+                        --now.tv_sec;
+                    }
+                    remaining = &now;
+                }
+                if (policy != OVERWRITE_OLDEST_OVERFLOW || !dropOldest(droppedCounts)) {
+                    // wait end of print
+                    if (spin < LOGGER_WAKEUP_SPIN) {
+                        ++spin;
+                        sched_yield();
+                    }
+                    else {
+                        waitRelease(remaining);
+                    }
+                }
+                tailCache = cursorTail(__atomic_load_n(&cursor, __ATOMIC_ACQUIRE));
+            }
+        }
+        if (padding > 0) {
+            Record* record = at(head);
+            record->size = padding;
+            record->isPadding = true;
+            head += padding;
+        }
+        Record* record = at(head);
+        record->size = size;
+        record->isPadding = false;
+        record->outOfLine = NULL;
+        record->dropped = dropped;
+        return record;
+    }
+
+    /**
+     * @brief Park the producer until the consumer releases records (producer side).
+     *
+     * @param timeout relative timeout or NULL.
+     */
+    void waitRelease(const struct timespec* timeout) {
+        __atomic_store_n(&isProducerWaiting, 1, __ATOMIC_RELAXED);
+        // the waiting flag is visible before the check of tail
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (cursorTail(__atomic_load_n(&cursor, __ATOMIC_ACQUIRE)) == tailCache) {
+            syscall(SYS_futex, &isProducerWaiting, FUTEX_WAIT_PRIVATE, 1, timeout, NULL, 0);
+        }
+        __atomic_store_n(&isProducerWaiting, 0, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Wake up the parked producer (consumer side).
+     */
+    void wakeProducer() {
+        if (__atomic_exchange_n(&isProducerWaiting, 0, __ATOMIC_ACQ_REL) != 0) {
+            syscall(SYS_futex, &isProducerWaiting, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+
+    /**
+     * @brief Drop the oldest record not taken by the consumer (producer side).
+     *
+     * @return false if the consumer prints the oldest records.
+     */
+    bool dropOldest(unsigned long* droppedCounts) {
+        uint64_t current = __atomic_load_n(&cursor, __ATOMIC_ACQUIRE);
+        unsigned int oldest = cursorTail(current);
+        if (oldest != cursorDrainHead(current) || oldest == publishedHead) {
+            return false;
+        }
+        Record* record = at(oldest);
+        unsigned int next = oldest + record->size;
+        if (!__atomic_compare_exchange_n(&cursor, &current, makeCursor(next, next), false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            // consumer takes the records
+            return false;
+        }
+        if (!record->isPadding) {
+            __atomic_add_fetch(&droppedCounts[record->message.level], 1, __ATOMIC_RELAXED);
+            dropped += record->dropped + 1;
+            delete[] record->outOfLine;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Publish the reserved records to the consumer.
+     */
+    void commit(Record* record) {
+        head += record->size;
+        dropped = 0;
+        __atomic_store_n(&publishedHead, head, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Take the published records (consumer side).
+     */
+    void take() {
+        uint64_t current = __atomic_load_n(&cursor, __ATOMIC_ACQUIRE);
+        unsigned int published = __atomic_load_n(&publishedHead, __ATOMIC_ACQUIRE);
+        // the producer can drop the oldest records while nothing is taken
+        while (!__atomic_compare_exchange_n(&cursor, &current, makeCursor(cursorTail(current), published), false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        }
+        tail = cursorTail(current);
+        drainHead = published;
+    }
+
+    /**
+     * @brief Release the oldest taken record (consumer side).
+     */
+    void release(unsigned int size) {
+        tail += size;
+        __atomic_store_n(&cursor, makeCursor(tail, drainHead), __ATOMIC_RELEASE);
+        // a missed flag is seen by the check at the end of drain
+        if (__atomic_load_n(&isProducerWaiting, __ATOMIC_RELAXED) != 0) {
+            wakeProducer();
+        }
+    }
+
+    // producer side
+    unsigned int head;
+    unsigned int tailCache;
+    // messages dropped since the last commit
+    unsigned long dropped;
+    char producerPadding[LOGGER_CACHE_LINE_SIZE - 2 * sizeof(unsigned int) - sizeof(unsigned long)];
+    // shared
+    unsigned int publishedHead;
+    char publishedPadding[LOGGER_CACHE_LINE_SIZE - sizeof(unsigned int)];
+    // tail and taken head, the producer changes it only when they are equals
+    uint64_t cursor;
+    // futex of the parked producer, woken by the consumer
+    int isProducerWaiting;
+    char cursorPadding[LOGGER_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(int)];
+    // consumer side
+    unsigned int tail;
+    unsigned int drainHead;
+    char consumerPadding[LOGGER_CACHE_LINE_SIZE - 2 * sizeof(unsigned int)];
+
+    bool isReleased;
+    Ring* next;
+    char* buffer;
+
+  private:
+    Ring(const Ring&); // disable copy
+    Ring& operator=(const Ring&); // disable copy
+};
+
+struct Logger::SinkEntry {
+    SinkEntry(Sink* sink_, eLevel level_, const char* format_, bool isBinary_ = false) :
+        sink(sink_),
+        level(level_),
+        hasFormat(format_ != NULL),
+        format(format_ != NULL ? format_ : ""),
+        isBinary(isBinary_),
+        isIndexed(sink_->isIndexed()),
+        isHeaderWritten(false),
+        lastStamp(0),
+        isStructured(false),
+        encoding(JSON_STRUCTURED) {}
+
+    /**
+     * @brief Call site of the binary stream.
+     */
+    struct Site {
+        const char* file;
+        const char* filename;
+        const char* function;
+        const char* format;
+        const char* signature;
+        int line;
+        int level;
+
+        bool operator<(const Site& rhs) const {
+            if (file != rhs.file) {
+                return file < rhs.file;
+            }
+            if (line != rhs.line) {
+                return line < rhs.line;
+            }
+            if (format != rhs.format) {
+                return format < rhs.format;
+            }
+            if (signature != rhs.signature) {
+                return signature < rhs.signature;
+            }
+            if (level != rhs.level) {
+                return level < rhs.level;
+            }
+            if (filename != rhs.filename) {
+                return filename < rhs.filename;
+            }
+            return function < rhs.function;
+        }
+    };
+
+    Sink* sink;
+    eLevel level;
+    // use the formats of logger if false
+    bool hasFormat;
+    std::string format;
+    // formats by level
+    std::vector<Format> formats;
+    // copy of formats used by the logger thread
+    std::vector<Format> threadFormats;
+    // rendered messages of the current batch
+    std::string buffer;
+
+    // binary stream
+    bool isBinary;
+    bool isIndexed;
+    bool isHeaderWritten;
+    std::string name;
+    int64_t lastStamp;
+    std::map<Site, unsigned long> sites;
+    // site records written again at the start of each file
+    std::string dictionary;
+
+    /**
+     * @brief Field of a structured entry rendered by its format.
+     */
+    struct Field {
+        std::string key;
+        std::string format;
+        bool isNumber;
+        std::vector<Format> formats;
+        // copy of formats used by the logger thread
+        std::vector<Format> threadFormats;
+    };
+
+    bool isStructured;
+    eStructuredFormat encoding;
+    std::vector<Field> fields;
+
+    bool isText() const {
+        return !isBinary && !isStructured;
+    }
+
+    /**
+     * @brief Order the entries with the same format side by side, binary and structured entries at the end.
+     */
+    static bool isFormatLess(const SinkEntry* lhs, const SinkEntry* rhs) {
+        if (lhs->isText() != rhs->isText()) {
+            return lhs->isText();
+        }
+        if (lhs->hasFormat != rhs->hasFormat) {
+            return !lhs->hasFormat;
+        }
+        return lhs->format < rhs->format;
+    }
+
+    static bool isFormatEqual(const SinkEntry* lhs, const SinkEntry* rhs) {
+        return lhs->isText() && rhs->isText() && lhs->hasFormat == rhs->hasFormat && lhs->format == rhs->format;
+    }
+};
+
+Logger::FileSink::FileSink(FILE* file) :
+    _file(file) {}
+
+Logger::FileSink::~FileSink() {}
+
+/**
+ * @brief Write all data on a descriptor.
+ *
+ * @return false on unrecoverable error.
+ */
+static bool s_writeAll(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t ret = ::write(fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // non blocking descriptor (pipe), wait the reader
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            // unrecoverable error (EPIPE, ENOSPC, ...)
+            return false;
+        }
+        data += ret;
+        size -= static_cast<std::size_t>(ret);
+    }
+    return true;
+}
+
+void Logger::FileSink::write(const char* data, std::size_t size) {
+    if (_file == NULL) {
+        return;
+    }
+    int fd = fileno(_file);
+    if (fd < 0) {
+        // FILE without descriptor (fmemopen, fopencookie)
+        fwrite(data, 1, size, _file);
+        return;
+    }
+    // keep the order with the messages of log already in the FILE buffer
+    fflush(_file);
+    s_writeAll(fd, data, size);
+}
+
+void Logger::FileSink::flush() {
+    if (_file != NULL) {
+        fflush(_file);
+    }
+}
+
+void Logger::FileSink::sync() {
+    if (_file != NULL) {
+        fflush(_file);
+        int fd = fileno(_file);
+        if (fd >= 0) {
+            // EINVAL for a pipe or a terminal
+            fdatasync(fd);
+        }
+    }
+}
+
+static int s_openLog(const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw Logger::Exception("open: ", path.c_str(), (std::string(": ") + strerror(errno)).c_str());
+    }
+    return fd;
+}
+
+#define LOGGER_INDEX_MAGIC "BLETIDX1"
+
+Logger::FileIndex::FileIndex(const char* path, std::size_t blockSize, bool isTruncated) :
+    _blockSize(blockSize),
+    _fd(-1),
+    _hasBlock(false) {
+    _fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (isTruncated ? O_TRUNC : 0), 0644);
+    if (_fd < 0) {
+        throw Exception("open: ", path, (std::string(": ") + strerror(errno)).c_str());
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == 0 && st.st_size == 0) {
+        s_writeAll(_fd, LOGGER_INDEX_MAGIC, sizeof(LOGGER_INDEX_MAGIC) - 1);
+    }
+    memset(&_block, 0, sizeof(_block));
+}
+
+Logger::FileIndex::~FileIndex() {
+    close(_fd);
+}
+
+void Logger::FileIndex::add(const Message& message, uint64_t offset) {
+    int64_t stamp = static_cast<int64_t>(message.ts.tv_sec) * 1000000000 + message.ts.tv_nsec;
+    if (_hasBlock && offset - _block.offset >= _blockSize) {
+        // the message starts the next block
+        _block.size = offset - _block.offset;
+        _blocks.push_back(_block);
+        _hasBlock = false;
+    }
+    if (!_hasBlock) {
+        _block.minStamp = stamp;
+        _block.maxStamp = stamp;
+        _block.offset = offset;
+        _block.size = 0;
+        _block.levels = 0;
+        _hasBlock = true;
+    }
+    _block.minStamp = std::min(_block.minStamp, stamp);
+    _block.maxStamp = std::max(_block.maxStamp, stamp);
+    _block.levels |= 1u << message.level;
+}
+
+void Logger::FileIndex::write() {
+    if (!_blocks.empty()) {
+        s_writeAll(_fd, reinterpret_cast<const char*>(&_blocks[0]), _blocks.size() * sizeof(Block));
+        _blocks.clear();
+    }
+}
+
+void Logger::FileIndex::finish(uint64_t end) {
+    if (_hasBlock && end > _block.offset) {
+        _block.size = end - _block.offset;
+        _blocks.push_back(_block);
+    }
+    _hasBlock = false;
+    write();
+}
+
+void Logger::FileIndex::read(const char* path, std::vector<Block>& blocks) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        throw Exception("fopen: ", path, (std::string(": ") + strerror(errno)).c_str());
+    }
+    char magic[sizeof(LOGGER_INDEX_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, LOGGER_INDEX_MAGIC, sizeof(magic)) != 0) {
+        fclose(file);
+        throw Exception("FileIndex: ", path, ": invalid magic");
+    }
+    Block block;
+    // a truncated last block is ignored
+    while (fread(&block, sizeof(block), 1, file) == 1) {
+        blocks.push_back(block);
+    }
+    fclose(file);
+}
+
+void Logger::FileIndex::find(const std::vector<Block>& blocks, int64_t since, int64_t until, eLevel level,
+                             std::vector<Block>& found) {
+    // levels lower or equal to level
+    uint32_t levels = (2u << level) - 1;
+    for (std::vector<Block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        if (it->maxStamp < since || it->minStamp > until || (it->levels & levels) == 0) {
+            continue;
+        }
+        if (!found.empty() && found.back().offset + found.back().size == it->offset) {
+            Block& last = found.back();
+            last.size += it->size;
+            last.minStamp = std::min(last.minStamp, it->minStamp);
+            last.maxStamp = std::max(last.maxStamp, it->maxStamp);
+            last.levels |= it->levels;
+        }
+        else {
+            found.push_back(*it);
+        }
+    }
+}
+
+#undef LOGGER_INDEX_MAGIC
+
+Logger::RotatingFileSink::RotatingFileSink(const char* path, std::size_t maxSize, eRotation rotation,
+                                           unsigned int maxFiles, std::size_t indexBlockSize) :
+    _path(path),
+    _nextPath(_path + ".next"),
+    _maxSize(maxSize),
+    _rotation(rotation),
+    _maxFiles(maxFiles),
+    _fd(-1),
+    _nextFd(-1),
+    _size(0),
+    _nextRotation(0),
+    _indexBlockSize(indexBlockSize),
+    _index(NULL),
+    _isSplit(false) {
+    _fd = s_openLog(_path);
+    struct stat st;
+    if (fstat(_fd, &st) == 0) {
+        _size = static_cast<std::size_t>(st.st_size);
+    }
+    if (_indexBlockSize > 0) {
+        try {
+            // the new blocks follow the blocks of the existing file
+            _index = new FileIndex(FileIndex::getPath(_path).c_str(), _indexBlockSize);
+        }
+        catch (const Exception&) {
+            close(_fd);
+            throw;
+        }
+    }
+    // the next file is ready before the rotation
+    unlink(_nextPath.c_str());
+    _nextFd = s_openLog(_nextPath);
+    _nextRotation = _rotationTime(time(NULL));
+}
+
+Logger::RotatingFileSink::~RotatingFileSink() {
+    if (_index != NULL) {
+        _index->finish(_size);
+        delete _index;
+    }
+    close(_fd);
+    if (_nextFd >= 0) {
+        close(_nextFd);
+        unlink(_nextPath.c_str());
+    }
+}
+
+time_t Logger::RotatingFileSink::_rotationTime(time_t now) const {
+    if (_rotation == NO_ROTATION) {
+        return 0;
+    }
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    if (_rotation == HOURLY_ROTATION) {
+        ++tm.tm_hour;
+    }
+    else {
+        tm.tm_hour = 0;
+        ++tm.tm_mday;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+std::string Logger::RotatingFileSink::_rotatedPath(unsigned int index) const {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%u", index);
+    return _path + suffix;
+}
+
+void Logger::RotatingFileSink::_rotate() {
+    if (_nextFd < 0) {
+        // the previous open of next file failed
+        try {
+            _nextFd = s_openLog(_nextPath);
+        }
+        catch (const Exception&) {
+            return;
+        }
+    }
+    if (_index != NULL) {
+        _index->finish(_size);
+        delete _index;
+        _index = NULL;
+    }
+    // path.N-1 -> path.N, ..., path -> path.1 with their indexes
+    if (_maxFiles == 0) {
+        unlink(_path.c_str());
+        unlink(FileIndex::getPath(_path).c_str());
+    }
+    else {
+        unlink(_rotatedPath(_maxFiles).c_str());
+        unlink(FileIndex::getPath(_rotatedPath(_maxFiles)).c_str());
+        for (unsigned int i = _maxFiles - 1; i > 0; --i) {
+            rename(_rotatedPath(i).c_str(), _rotatedPath(i + 1).c_str());
+            rename(FileIndex::getPath(_rotatedPath(i)).c_str(), FileIndex::getPath(_rotatedPath(i + 1)).c_str());
+        }
+        rename(_path.c_str(), _rotatedPath(1).c_str());
+        rename(FileIndex::getPath(_path).c_str(), FileIndex::getPath(_rotatedPath(1)).c_str());
+    }
+    rename(_nextPath.c_str(), _path.c_str());
+    close(_fd);
+    _fd = _nextFd;
+    _size = 0;
+    if (_indexBlockSize > 0) {
+        try {
+            _index = new FileIndex(FileIndex::getPath(_path).c_str(), _indexBlockSize, true);
+        }
+        catch (const Exception&) {
+            // the file is not indexed
+            _index = NULL;
+        }
+    }
+    try {
+        _nextFd = s_openLog(_nextPath);
+    }
+    catch (const Exception&) {
+        _nextFd = -1;
+    }
+}
+
+void Logger::RotatingFileSink::write(const char* data, std::size_t size) {
+    if (_nextRotation != 0 && !_isSplit) {
+        time_t now = time(NULL);
+        if (now >= _nextRotation) {
+            if (_size > 0) {
+                _rotate();
+            }
+            _nextRotation = _rotationTime(now);
+        }
+    }
+    std::vector<std::pair<std::size_t, Message> >::const_iterator mark = _marks.begin();
+    std::vector<std::size_t>::const_iterator split = _splits.begin();
+    std::size_t position = 0;
+    while (size > 0) {
+        std::size_t chunk = size;
+        if (split != _splits.end()) {
+            if (*split == position) {
+                // the record starts by the header of binary stream
+                _rotate();
+                ++split;
+                continue;
+            }
+            chunk = *split - position;
+        }
+        else if (!_isSplit && _maxSize > 0 && _size + size > _maxSize) {
+            // last complete message in the file
+            std::size_t available = (_size < _maxSize) ? _maxSize - _size : 0;
+            const char* end = static_cast<const char*>(memrchr(data, '\n', std::min(available, size)));
+            if (end != NULL) {
+                chunk = end - data + 1;
+            }
+            else if (_size > 0) {
+                _rotate();
+                continue;
+            }
+            else {
+                // message bigger than maxSize
+                const char* lineEnd = static_cast<const char*>(memchr(data, '\n', size));
+                chunk = (lineEnd != NULL) ? static_cast<std::size_t>(lineEnd - data + 1) : size;
+            }
+        }
+        if (_index != NULL) {
+            // messages of chunk
+            for (; mark != _marks.end() && mark->first < position + chunk; ++mark) {
+                _index->add(mark->second, _size + (mark->first - position));
+            }
+        }
+        s_writeAll(_fd, data, chunk);
+        _size += chunk;
+        data += chunk;
+        size -= chunk;
+        position += chunk;
+    }
+    _marks.clear();
+    _splits.clear();
+    if (_index != NULL) {
+        _index->write();
+    }
+}
+
+void Logger::RotatingFileSink::index(const Message& message, std::size_t offset) {
+    _marks.push_back(std::make_pair(offset, message));
+}
+
+bool Logger::RotatingFileSink::split(std::size_t offset, std::size_t size) {
+    _isSplit = true;
+    // size of file before the record
+    std::size_t fileSize = _splits.empty() ? _size + offset : offset - _splits.back();
+    bool isRotated = _maxSize > 0 && fileSize + size > _maxSize;
+    if (_nextRotation != 0) {
+        time_t now = time(NULL);
+        if (now >= _nextRotation) {
+            isRotated = true;
+            _nextRotation = _rotationTime(now);
+        }
+    }
+    if (!isRotated || fileSize == 0) {
+        return false;
+    }
+    _splits.push_back(offset);
+    return true;
+}
+
+Logger::MmapFileSink::MmapFileSink(const char* path, std::size_t segmentSize, std::size_t syncWindow,
+                                   std::size_t indexBlockSize) :
+    _path(path),
+    _segmentSize(segmentSize),
+    _syncWindow(syncWindow),
+    _index(0),
+    _fd(-1),
+    _map(NULL),
+    _mapSize(0),
+    _cursor(0),
+    _syncCursor(0),
+    _indexBlockSize(indexBlockSize),
+    _fileIndex(NULL),
+    _isSplit(false) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    _pageSize = (pageSize > 0) ? static_cast<std::size_t>(pageSize) : 4096;
+    // mapping by pages
+    _segmentSize = (_segmentSize + _pageSize - 1) / _pageSize * _pageSize;
+    _syncWindow = (_syncWindow + _pageSize - 1) / _pageSize * _pageSize;
+    if (_segmentSize == 0) {
+        _segmentSize = _pageSize;
+    }
+    // first segment not used
+    while (access(_segmentPath(_index).c_str(), F_OK) == 0) {
+        ++_index;
+    }
+    _open(_segmentSize);
+}
+
+Logger::MmapFileSink::~MmapFileSink() {
+    _close();
+}
+
+std::string Logger::MmapFileSink::_segmentPath(unsigned int index) const {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%u", index);
+    return _path + suffix;
+}
+
+void Logger::MmapFileSink::_open(std::size_t size) {
+    std::string path = _segmentPath(_index);
+    _fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw Exception("open: ", path.c_str(), (std::string(": ") + strerror(errno)).c_str());
+    }
+    // reserve the blocks of segment, ftruncate if the filesystem has not fallocate
+    if (fallocate(_fd, 0, 0, static_cast<off_t>(size)) != 0 && ftruncate(_fd, static_cast<off_t>(size)) != 0) {
+        int error = errno;
+        close(_fd);
+        _fd = -1;
+        throw Exception("fallocate: ", path.c_str(), (std::string(": ") + strerror(error)).c_str());
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) {
+        int error = errno;
+        close(_fd);
+        _fd = -1;
+        throw Exception("mmap: ", path.c_str(), (std::string(": ") + strerror(error)).c_str());
+    }
+    _map = static_cast<char*>(map);
+    _mapSize = size;
+    _cursor = 0;
+    _syncCursor = 0;
+    if (_indexBlockSize > 0) {
+        try {
+            _fileIndex = new FileIndex(FileIndex::getPath(path).c_str(), _indexBlockSize, true);
+        }
+        catch (const Exception&) {
+            // the segment is not indexed
+            _fileIndex = NULL;
+        }
+    }
+}
+
+void Logger::MmapFileSink::_close() {
+    if (_fd < 0) {
+        return;
+    }
+    munmap(_map, _mapSize);
+    if (_fileIndex != NULL) {
+        _fileIndex->finish(_cursor);
+        delete _fileIndex;
+        _fileIndex = NULL;
+    }
+    // remove the preallocated end
+    if (ftruncate(_fd, static_cast<off_t>(_cursor)) != 0) {
+        // keep the zeros at the end of segment
+    }
+    close(_fd);
+    _fd = -1;
+    _map = NULL;
+}
+
+void Logger::MmapFileSink::_sync(bool isAll) {
+    std::size_t end = isAll ? _cursor : _cursor / _pageSize * _pageSize;
+    if (end <= _syncCursor) {
+        return;
+    }
+    // start the write back and release the written pages of the process
+    msync(_map + _syncCursor, end - _syncCursor, MS_ASYNC);
+    if (!isAll) {
+        madvise(_map + _syncCursor, end - _syncCursor, MADV_DONTNEED);
+        _syncCursor = end;
+    }
+}
+
+void Logger::MmapFileSink::write(const char* data, std::size_t size) {
+    std::vector<std::pair<std::size_t, Message> >::const_iterator mark = _marks.begin();
+    std::vector<std::size_t>::const_iterator split = _splits.begin();
+    std::size_t position = 0;
+    while (size > 0 && _fd >= 0) {
+        std::size_t chunk = size;
+        if (_isSplit) {
+            bool isNext = split != _splits.end() && *split == position;
+            if (isNext) {
+                ++split;
+            }
+            if (split != _splits.end()) {
+                chunk = *split - position;
+            }
+            if (isNext || _cursor + chunk > _mapSize) {
+                // the record starts by the header of binary stream,
+                // or the empty segment is bigger for a record bigger than a segment
+                bool isUsed = _cursor > 0;
+                _close();
+                if (isUsed) {
+                    ++_index;
+                }
+                try {
+                    _open(std::max(_segmentSize, (chunk + _pageSize - 1) / _pageSize * _pageSize));
+                }
+                catch (const Exception&) {
+                    // lost the messages
+                    _marks.clear();
+                    _splits.clear();
+                    return;
+                }
+            }
+        }
+        else if (_cursor + size > _mapSize) {
+            // last complete message in the segment
+            const char* end = static_cast<const char*>(memrchr(data, '\n', _mapSize - _cursor));
+            if (end != NULL) {
+                chunk = end - data + 1;
+            }
+            else {
+                const char* lineEnd = static_cast<const char*>(memchr(data, '\n', size));
+                std::size_t lineSize = (lineEnd != NULL) ? static_cast<std::size_t>(lineEnd - data + 1) : size;
+                // next segment, bigger for a message bigger than a segment
+                _close();
+                ++_index;
+                try {
+                    _open(std::max(_segmentSize, (lineSize + _pageSize - 1) / _pageSize * _pageSize));
+                }
+                catch (const Exception&) {
+                    // lost the messages
+                    _marks.clear();
+                    return;
+                }
+                continue;
+            }
+        }
+        if (_fileIndex != NULL) {
+            // messages of chunk
+            for (; mark != _marks.end() && mark->first < position + chunk; ++mark) {
+                _fileIndex->add(mark->second, _cursor + (mark->first - position));
+            }
+        }
+        memcpy(_map + _cursor, data, chunk);
+        _cursor += chunk;
+        data += chunk;
+        size -= chunk;
+        position += chunk;
+        if (_syncWindow > 0 && _cursor - _syncCursor >= _syncWindow) {
+            _sync(false);
+        }
+    }
+    _marks.clear();
+    _splits.clear();
+    if (_fileIndex != NULL) {
+        _fileIndex->write();
+    }
+}
+
+void Logger::MmapFileSink::index(const Message& message, std::size_t offset) {
+    _marks.push_back(std::make_pair(offset, message));
+}
+
+bool Logger::MmapFileSink::split(std::size_t offset, std::size_t size) {
+    _isSplit = true;
+    // size of segment before the record
+    std::size_t segmentSize = _splits.empty() ? _cursor + offset : offset - _splits.back();
+    std::size_t capacity = _splits.empty() ? _mapSize : _segmentSize;
+    if (segmentSize == 0 || segmentSize + size <= capacity) {
+        return false;
+    }
+    _splits.push_back(offset);
+    return true;
+}
+
+void Logger::MmapFileSink::flush() {
+    if (_fd >= 0) {
+        _sync(true);
+    }
+}
+
+void Logger::MmapFileSink::sync() {
+    if (_fd >= 0 && _cursor > _syncCursor) {
+        msync(_map + _syncCursor, _cursor - _syncCursor, MS_SYNC);
+    }
+}
+
+#define LOGGER_URING_FSYNC_DATA (~static_cast<uint64_t>(0))
+
+Logger::UringFileSink::UringFileSink(const char* path, unsigned int queueDepth, std::size_t bufferSize) :
+    _path(path),
+    _fd(-1),
+    _offset(0),
+    _ringFd(-1),
+    _sqRing(NULL),
+    _sqRingSize(0),
+    _cqRing(NULL),
+    _cqRingSize(0),
+    _sqes(NULL),
+    _sqesSize(0),
+    _sqTail(0),
+    _sqMask(0),
+    _cqMask(0),
+    _sqTailPtr(NULL),
+    _sqArray(NULL),
+    _cqHeadPtr(NULL),
+    _cqTailPtr(NULL),
+    _cqes(NULL),
+    _inFlight(0) {
+    _fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw Exception("open: ", _path.c_str(), (std::string(": ") + strerror(errno)).c_str());
+    }
+    // append at the end of file
+    struct stat st;
+    if (fstat(_fd, &st) == 0) {
+        _offset = static_cast<uint64_t>(st.st_size);
+    }
+    if (queueDepth > 0) {
+        _buffers.resize(queueDepth);
+        for (std::size_t i = 0; i < _buffers.size(); ++i) {
+            _buffers[i].data = new char[bufferSize];
+            _buffers[i].capacity = bufferSize;
+        }
+        if (!_setup(queueDepth)) {
+            // write(2) fallback
+            for (std::size_t i = 0; i < _buffers.size(); ++i) {
+                delete[] _buffers[i].data;
+            }
+            _buffers.clear();
+        }
+    }
+}
+
+Logger::UringFileSink::~UringFileSink() {
+    if (_ringFd >= 0) {
+        // wait the writes in flight
+        while (_inFlight > 0) {
+            _reap(true);
+        }
+        munmap(_sqes, _sqesSize);
+        if (_cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+        munmap(_sqRing, _sqRingSize);
+        close(_ringFd);
+    }
+    for (std::size_t i = 0; i < _buffers.size(); ++i) {
+        delete[] _buffers[i].data;
+    }
+    close(_fd);
+}
+
+bool Logger::UringFileSink::_setup(unsigned int queueDepth) {
+#ifdef LOGGER_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // a write by buffer and a fsync
+    _ringFd = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth + 1, &params));
+    if (_ringFd < 0) {
+        return false;
+    }
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool isSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (isSingleMmap) {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd,
+                   IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        close(_ringFd);
+        _ringFd = -1;
+        return false;
+    }
+    _cqRing = _sqRing;
+    if (!isSingleMmap) {
+        _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd,
+                       IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            munmap(_sqRing, _sqRingSize);
+            close(_ringFd);
+            _ringFd = -1;
+            return false;
+        }
+    }
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        if (_cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+        munmap(_sqRing, _sqRingSize);
+        close(_ringFd);
+        _ringFd = -1;
+        return false;
+    }
+    char* sq = static_cast<char*>(_sqRing);
+    char* cq = static_cast<char*>(_cqRing);
+    _sqTailPtr = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    _sqTail = *_sqTailPtr;
+    _cqHeadPtr = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    _cqTailPtr = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    _cqes = cq + params.cq_off.cqes;
+    // registered buffers are not mapped at each write
+    std::vector<struct iovec> iovecs(_buffers.size());
+    for (std::size_t i = 0; i < _buffers.size(); ++i) {
+        iovecs[i].iov_base = _buffers[i].data;
+        iovecs[i].iov_len = _buffers[i].capacity;
+    }
+    if (syscall(__NR_io_uring_register, _ringFd, IORING_REGISTER_BUFFERS, &iovecs[0], iovecs.size()) < 0) {
+        munmap(_sqes, _sqesSize);
+        if (_cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+        munmap(_sqRing, _sqRingSize);
+        close(_ringFd);
+        _ringFd = -1;
+        return false;
+    }
+    return true;
+#else
+    (void)queueDepth;
+    return false;
+#endif
+}
+
+void Logger::UringFileSink::_submitWrite(unsigned int index) {
+#ifdef LOGGER_URING
+    Buffer& buffer = _buffers[index];
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + (_sqTail & _sqMask);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = _fd;
+    sqe->off = buffer.offset + buffer.written;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer.data + buffer.written);
+    sqe->len = static_cast<uint32_t>(buffer.size - buffer.written);
+    sqe->buf_index = static_cast<uint16_t>(index);
+    sqe->user_data = index;
+    _sqArray[_sqTail & _sqMask] = _sqTail & _sqMask;
+    ++_sqTail;
+    __atomic_store_n(_sqTailPtr, _sqTail, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, _ringFd, 1, 0, 0, NULL, 0) < 0 && errno == EINTR) {
+    }
+#else
+    (void)index;
+#endif
+}
+
+void Logger::UringFileSink::_reap(bool isWaiting) {
+#ifdef LOGGER_URING
+    if (isWaiting) {
+        while (syscall(__NR_io_uring_enter, _ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+               errno == EINTR) {
+        }
+    }
+    unsigned int head = *_cqHeadPtr;
+    unsigned int tail = __atomic_load_n(_cqTailPtr, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe* cqe = static_cast<const struct io_uring_cqe*>(_cqes) + (head & _cqMask);
+        if (cqe->user_data == LOGGER_URING_FSYNC_DATA) {
+            --_inFlight;
+            continue;
+        }
+        Buffer& buffer = _buffers[static_cast<std::size_t>(cqe->user_data)];
+        if (cqe->res > 0) {
+            buffer.written += static_cast<std::size_t>(cqe->res);
+        }
+        if (buffer.written < buffer.size && (cqe->res > 0 || cqe->res == -EINTR || cqe->res == -EAGAIN)) {
+            // short write, write the end of buffer
+            __atomic_store_n(_cqHeadPtr, head + 1, __ATOMIC_RELEASE);
+            _submitWrite(static_cast<unsigned int>(cqe->user_data));
+            continue;
+        }
+        // written or unrecoverable error (ENOSPC, EIO, ...)
+        buffer.isBusy = false;
+        --_inFlight;
+    }
+    __atomic_store_n(_cqHeadPtr, head, __ATOMIC_RELEASE);
+#else
+    (void)isWaiting;
+#endif
+}
+
+void Logger::UringFileSink::write(const char* data, std::size_t size) {
+    if (_ringFd < 0) {
+        if (s_writeAll(_fd, data, size)) {
+            _offset += size;
+        }
+        return;
+    }
+    _reap(false);
+    while (size > 0) {
+        unsigned int index = 0;
+        while (index < _buffers.size() && _buffers[index].isBusy) {
+            ++index;
+        }
+        if (index == _buffers.size()) {
+            // all buffers are in flight
+            _reap(true);
+            continue;
+        }
+        Buffer& buffer = _buffers[index];
+        std::size_t chunk = std::min(size, buffer.capacity);
+        memcpy(buffer.data, data, chunk);
+        buffer.size = chunk;
+        buffer.written = 0;
+        buffer.offset = _offset;
+        buffer.isBusy = true;
+        ++_inFlight;
+        _submitWrite(index);
+        _offset += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void Logger::UringFileSink::flush() {
+    if (_ringFd < 0) {
+        return;
+    }
+    while (_inFlight > 0) {
+        _reap(true);
+    }
+}
+
+void Logger::UringFileSink::sync() {
+    if (_ringFd < 0) {
+        fdatasync(_fd);
+        return;
+    }
+#ifdef LOGGER_URING
+    // fdatasync after all writes in flight
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + (_sqTail & _sqMask);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->flags = IOSQE_IO_DRAIN;
+    sqe->fd = _fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = LOGGER_URING_FSYNC_DATA;
+    _sqArray[_sqTail & _sqMask] = _sqTail & _sqMask;
+    ++_sqTail;
+    __atomic_store_n(_sqTailPtr, _sqTail, __ATOMIC_RELEASE);
+    ++_inFlight;
+    while (syscall(__NR_io_uring_enter, _ringFd, 1, 0, 0, NULL, 0) < 0 && errno == EINTR) {
+    }
+    while (_inFlight > 0) {
+        _reap(true);
+    }
+#endif
+}
+
+#undef LOGGER_URING_FSYNC_DATA
+
+void Logger::RotatingFileSink::sync() {
+    fdatasync(_fd);
+}
+
+struct Logger::Backend::Worker {
+    Worker(Backend* backend_) :
+        backend(backend_),
+        isStarted(true),
+        isSleeping(0),
+        tid(0),
+        generation(0),
+        threadGeneration(0),
+        next(0) {}
+
+    Backend* backend;
+    bool isStarted;
+    // futex of the parked thread, woken by the loggers
+    int isSleeping;
+    pthread_t threadId;
+    // kernel id of the thread, protected by Backend::_mutex
+    pid_t tid;
+    // protected by Backend::_mutex
+    std::vector<Logger*> loggers;
+    unsigned long generation;
+    // generation of threadLoggers, written by the thread with Backend::_mutex
+    unsigned long threadGeneration;
+    // used by the thread
+    std::vector<Logger*> threadLoggers;
+    std::size_t next;
+};
+
+struct Logger::Backend::ThreadRings {
+    ThreadRings(Backend* backend_) :
+        backend(backend_) {}
+
+    Backend* backend;
+    // written only by the producer thread
+    std::vector<std::pair<unsigned long, Ring*> > rings;
+};
+
+Logger::Logger(Backend* backend) :
+    _isStarted(true),
+    _level(DEBUG),
+    _clock(REALTIME_CLOCK),
+#ifdef LOGGER_ASYNC_DROP_OVERFLOW
+    _overflowPolicy(DROP_NEWEST_OVERFLOW),
+#else
+    _overflowPolicy(BLOCK_OVERFLOW),
+#endif
+    _overflowTimeout(0),
+    _batchDelay(0),
+    _isSleeping(0),
+    _backend(backend),
+    _worker(NULL),
+    _backendId(0),
+    _isWakeRequested(false),
+    _threadLogTid(0),
+    _rings(NULL),
+    _flushSequence(0),
+    _writtenSequence(0),
+    _flushFd(-1),
+    _flushCallback(NULL),
+    _flushUserData(NULL),
+    _crashFd(-1),
+    _crashTimeout(0),
+    _crashTicket(0),
+    _durableLevels(0),
+    _isSanitized(false),
+    _syncSequence(0),
+    _syncedSequence(0),
+    _fileSink(stdout),
+    _sinksGeneration(1),
+    _threadSinksGeneration(0),
+    _sinksBufferSize(0),
+    _renderBuffer(LOGGER_MESSAGE_MAX_SIZE, '\0') {
+    memset(_droppedCounts, 0, sizeof(_droppedCounts));
+    // init thread, the formats are protected by _logMutex
+    if (pthread_mutex_init(&_logMutex, NULL)) {
+        throw Exception("pthread_mutex_init: ", strerror(errno));
+    }
+    // default file
+    _sinks.push_back(new SinkEntry(&_fileSink, DEBUG, NULL));
+    // default format
+    setAllFormat(LOGGER_DEFAULT_FORMAT);
+    // timeout of flush is not changed by the realtime clock
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&_condLog, &condAttr)) {
+        pthread_condattr_destroy(&condAttr);
+        throw Exception("pthread_cond_init: ", strerror(errno));
+    }
+    pthread_condattr_destroy(&condAttr);
+    if (_backend != NULL) {
+        // the rings are found by the key of backend
+        _worker = _backend->_attach(this);
+    }
+    else {
+        if (pthread_key_create(&_ringKey, &_threadRingRelease)) {
+            throw Exception("pthread_key_create: ", strerror(errno));
+        }
+        if (pthread_create(&_threadLogId, NULL, &_threadLogger, this)) {
+            throw Exception("pthread_create: ", strerror(errno));
+        }
+    }
+
+#ifdef LOGGER_PERF_DEBUG
+    clock_gettime(CLOCK_MONOTONIC, &_startTs);
+    _messageCount = 0;
+    _messagePrinted = 0;
+#endif
+}
+
+Logger::~Logger() {
+    _crashUnregister();
+    if (_backend != NULL) {
+        // the thread of backend does not drain this logger after _detach
+        _backend->_detach(_worker, this);
+        __atomic_store_n(&_isStarted, false, __ATOMIC_RELEASE);
+        // write the last messages
+        _threadWork();
+    }
+    else {
+        __atomic_store_n(&_isStarted, false, __ATOMIC_RELEASE);
+        // unlock thread
+        _wakeUp(true);
+        pthread_join(_threadLogId, NULL);
+        // producer threads can not release their ring after this point
+        pthread_key_delete(_ringKey);
+    }
+    // delete rings
+    while (_rings != NULL) {
+        Ring* next = _rings->next;
+        delete _rings;
+        _rings = next;
+    }
+    for (std::vector<SinkEntry*>::iterator it = _sinks.begin(); it != _sinks.end(); ++it) {
+        delete *it;
+    }
+    pthread_cond_destroy(&_condLog);
+    pthread_mutex_destroy(&_logMutex);
+    if (_flushFd >= 0) {
+        close(_flushFd);
+    }
+
+#ifdef LOGGER_PERF_DEBUG
+    timespec endTs;
+    clock_gettime(CLOCK_MONOTONIC, &endTs);
+    if ((endTs.tv_nsec - _startTs.tv_nsec) < 0) {
+        endTs.tv_nsec = 1000000000 + (endTs.tv_nsec - _startTs.tv_nsec);
+        endTs.tv_sec -= 1;
+    }
+    else {
+        endTs.tv_nsec = endTs.tv_nsec - _startTs.tv_nsec;
+    }
+    fprintf(stderr, "LOGGER_PERF %s:\n", _name.c_str());
+    fprintf(stderr, "- Time: %ld.%09ld\n", (endTs.tv_sec - _startTs.tv_sec), endTs.tv_nsec);
+    fprintf(stderr, "- Message counted: %u\n", _messageCount);
+    fprintf(stderr, "- Message printed: %u\n", _messagePrinted);
+    fprintf(stderr, "- Message rate: %f\n", _messagePrinted / ((endTs.tv_sec - _startTs.tv_sec) * 1000000000.0 + endTs.tv_nsec) * 1000000000);
+    fflush(stderr);
+#endif
+}
+
+int Logger::getFlushFd() const {
+    int flushFd = __atomic_load_n(&_flushFd, __ATOMIC_ACQUIRE);
+    if (flushFd >= 0) {
+        return flushFd;
+    }
+    flushFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (flushFd < 0) {
+        throw Exception("eventfd: ", strerror(errno));
+    }
+    // readable for the tickets written before the creation
+    uint64_t event = 1;
+    while (write(flushFd, &event, sizeof(event)) < 0 && errno == EINTR) {
+    }
+    int expected = -1;
+    if (!__atomic_compare_exchange_n(&const_cast<Logger*>(this)->_flushFd, &expected, flushFd, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // created by another thread
+        close(flushFd);
+        return expected;
+    }
+    return flushFd;
+}
+
+void Logger::flush() {
+    flush(-1);
+}
+
+bool Logger::flush(int64_t timeout) {
+    if (!__atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE)) {
+        _fileSink.flush();
+        return true;
+    }
+    unsigned long sequence = __atomic_add_fetch(&_flushSequence, 1, __ATOMIC_SEQ_CST);
+    struct timespec deadline;
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += static_cast<time_t>(timeout / 1000000000);
+        deadline.tv_nsec += static_cast<long>(timeout % 1000000000);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            ++deadline.tv_sec;
+        }
+    }
+    bool isFlushed = true;
+    pthread_mutex_lock(&_logMutex);
+    _wakeUp(true);
+    // wait the write of a drain started after this call
+    while (static_cast<long>(_writtenSequence - sequence) < 0) {
+        if (timeout < 0) {
+            pthread_cond_wait(&_condLog, &_logMutex);
+        }
+        else if (pthread_cond_timedwait(&_condLog, &_logMutex, &deadline) == ETIMEDOUT) {
+            isFlushed = static_cast<long>(_writtenSequence - sequence) >= 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_logMutex);
+    return isFlushed;
+}
+
+unsigned long Logger::flushAsync() {
+    unsigned long sequence = __atomic_add_fetch(&_flushSequence, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE)) {
+        _fileSink.flush();
+        return sequence;
+    }
+    _wakeUp(true);
+    return sequence;
+}
+
+bool Logger::isFlushed(unsigned long ticket) const {
+    if (!__atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    return static_cast<long>(__atomic_load_n(&_writtenSequence, __ATOMIC_ACQUIRE) - ticket) >= 0;
+}
+
+void Logger::setFlushCallback(FlushCallback callback, void* userData) {
+    pthread_mutex_lock(&_logMutex);
+    _flushCallback = callback;
+    _flushUserData = userData;
+    pthread_mutex_unlock(&_logMutex);
+}
+
+void* Logger::_threadLogger(void* e) {
+    Logger* loggin = static_cast<Logger*>(e);
+    pthread_mutex_lock(&loggin->_logMutex);
+    loggin->_threadLogTid = static_cast<pid_t>(syscall(SYS_gettid));
+    pthread_mutex_unlock(&loggin->_logMutex);
+    pthread_cond_broadcast(&loggin->_condLog);
+    loggin->_threadLog();
+    return NULL;
+}
+
+static void s_threadAffinity(pid_t tid, const std::vector<int>& cpus) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+            throw Logger::Exception("setThreadAffinity: ", "invalid cpu");
+        }
+        CPU_SET(cpus[i], &cpuSet);
+    }
+    if (sched_setaffinity(tid, sizeof(cpuSet), &cpuSet) < 0) {
+        throw Logger::Exception("sched_setaffinity: ", strerror(errno));
+    }
+}
+
+static void s_threadPriority(pid_t tid, int policy, int priority) {
+    bool isRealtime = policy == SCHED_FIFO || policy == SCHED_RR;
+    struct sched_param param;
+    param.sched_priority = isRealtime ? priority : 0;
+    if (sched_setscheduler(tid, policy, &param) < 0) {
+        throw Logger::Exception("sched_setscheduler: ", strerror(errno));
+    }
+    // the nice value is by thread on linux
+    if (!isRealtime && setpriority(PRIO_PROCESS, static_cast<id_t>(tid), priority) < 0) {
+        throw Logger::Exception("setpriority: ", strerror(errno));
+    }
+}
+
+static void s_threadName(pthread_t threadId, const char* name) {
+    // the name of a thread has 15 characters
+    char threadName[16];
+    snprintf(threadName, sizeof(threadName), "%s", name);
+    int error = pthread_setname_np(threadId, threadName);
+    if (error) {
+        throw Logger::Exception("pthread_setname_np: ", strerror(error));
+    }
+}
+
+pid_t Logger::_threadTid() {
+    if (_backend != NULL) {
+        throw Exception("logger thread: ", "the threads are set by the backend");
+    }
+    pthread_mutex_lock(&_logMutex);
+    // wait the start of thread
+    while (_threadLogTid == 0) {
+        pthread_cond_wait(&_condLog, &_logMutex);
+    }
+    pid_t tid = _threadLogTid;
+    pthread_mutex_unlock(&_logMutex);
+    return tid;
+}
+
+void Logger::setThreadAffinity(const std::vector<int>& cpus) {
+    s_threadAffinity(_threadTid(), cpus);
+}
+
+void Logger::setThreadPriority(int policy, int priority) {
+    s_threadPriority(_threadTid(), policy, priority);
+}
+
+void Logger::setThreadName(const char* name) {
+    _threadTid();
+    s_threadName(_threadLogId, name);
+}
+
+const char* Logger::_levelName(eLevel level) {
+    switch (level) {
+        case EMERGENCY:
+            return "EMERG";
+        case ALERT:
+            return "ALERT";
+        case CRITICAL:
+            return "CRIT";
+        case ERROR:
+            return "ERROR";
+        case WARNING:
+            return "WARN";
+        case NOTICE:
+            return "NOTICE";
+        case INFO:
+            return "INFO";
+        case DEBUG:
+            return "DEBUG";
+    }
+    return "";
+}
+
+Logger::Format* Logger::_levelFormat(eLevel level) {
+    switch (level) {
+        case EMERGENCY:
+            return &_emergencyFormat;
+        case ALERT:
+            return &_alertFormat;
+        case CRITICAL:
+            return &_criticalFormat;
+        case ERROR:
+            return &_errorFormat;
+        case WARNING:
+            return &_warningFormat;
+        case NOTICE:
+            return &_noticeFormat;
+        case INFO:
+            return &_infoFormat;
+        case DEBUG:
+            break;
+    }
+    return &_debugFormat;
+}
+
+const Logger::Format* Logger::_levelFormat(eLevel level) const {
+    return const_cast<Logger*>(this)->_levelFormat(level);
+}
+
+/**
+ * @brief Length of the valid UTF-8 sequence at str or 0.
+ */
+static std::size_t s_utf8Length(const unsigned char* str, const unsigned char* end) {
+    unsigned char c = str[0];
+    std::size_t length;
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        length = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+        length = 3;
+        // overlong and surrogates
+        if (c == 0xE0) {
+            min = 0xA0;
+        }
+        else if (c == 0xED) {
+            max = 0x9F;
+        }
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        length = 4;
+        // overlong and after U+10FFFF
+        if (c == 0xF0) {
+            min = 0x90;
+        }
+        else if (c == 0xF4) {
+            max = 0x8F;
+        }
+    }
+    else {
+        return 0;
+    }
+    if (static_cast<std::size_t>(end - str) < length || str[1] < min || str[1] > max) {
+        return 0;
+    }
+    for (std::size_t i = 2; i < length; ++i) {
+        if (str[i] < 0x80 || str[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Position of the first byte lower than 0x20, backslash, DEL or not ASCII.
+ */
+static const char* s_findUnclean(const char* str, const char* end) {
+    for (; str != end; ++str) {
+        unsigned char c = static_cast<unsigned char>(*str);
+        if (c < 0x20 || c == '\\' || c >= 0x7F) {
+            break;
+        }
+    }
+    return str;
+}
+
+#if defined(__SSE2__)
+static int s_uncleanMaskSse2(const char* str) {
+    // the bytes >= 0x80 are negative, the signed compare finds them with the control bytes
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+    __m128i control = _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x20));
+    __m128i del = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(0x7F));
+    __m128i backslash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(control, del), backslash));
+}
+
+static const char* s_findUncleanSse2(const char* str, const char* end) {
+    if (end - str < 16) {
+        return s_findUnclean(str, end);
+    }
+    for (; end - str > 16; str += 16) {
+        int mask = s_uncleanMaskSse2(str);
+        if (mask != 0) {
+            return str + __builtin_ctz(mask);
+        }
+    }
+    // last block overlaps the clean bytes already checked
+    str = end - 16;
+    int mask = s_uncleanMaskSse2(str);
+    return (mask != 0) ? str + __builtin_ctz(mask) : end;
+}
+#endif
+
+#if defined(LOGGER_SANITIZE_AVX2)
+static __attribute__((target("avx2"))) unsigned int s_uncleanMaskAvx2(const char* str) {
+    // signed compare: 0x20 > byte
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str));
+    __m256i control = _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), chunk);
+    __m256i del = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(0x7F));
+    __m256i backslash = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'));
+    return static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(control, del), backslash)));
+}
+
+static __attribute__((target("avx2"))) const char* s_findUncleanAvx2(const char* str, const char* end) {
+    if (end - str < 32) {
+        return s_findUncleanSse2(str, end);
+    }
+    for (; end - str > 32; str += 32) {
+        unsigned int mask = s_uncleanMaskAvx2(str);
+        if (mask != 0) {
+            return str + __builtin_ctz(mask);
+        }
+    }
+    // last block overlaps the clean bytes already checked
+    str = end - 32;
+    unsigned int mask = s_uncleanMaskAvx2(str);
+    return (mask != 0) ? str + __builtin_ctz(mask) : end;
+}
+#endif
+
+typedef const char* (*FindUncleanFunction)(const char* str, const char* end);
+
+static FindUncleanFunction s_findUncleanFunction() {
+#if defined(LOGGER_SANITIZE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &s_findUncleanAvx2;
+    }
+#endif
+#if defined(__SSE2__)
+    return &s_findUncleanSse2;
+#else
+    return &s_findUnclean;
+#endif
+}
+
+void Logger::sanitize(std::string& buffer, const char* str, std::size_t size) {
+    static const FindUncleanFunction findUnclean = s_findUncleanFunction();
+    static const char hex[] = "0123456789abcdef";
+    const char* end = str + size;
+    while (str != end) {
+        const char* unclean = findUnclean(str, end);
+        buffer.append(str, unclean - str);
+        if (unclean == end) {
+            break;
+        }
+        str = unclean;
+        unsigned char c = static_cast<unsigned char>(*str);
+        if (c >= 0x80) {
+            std::size_t length =
+                s_utf8Length(reinterpret_cast<const unsigned char*>(str), reinterpret_cast<const unsigned char*>(end));
+            if (length > 0) {
+                buffer.append(str, length);
+                str += length;
+                continue;
+            }
+        }
+        char escape[4] = {'\\', 'x', hex[c >> 4], hex[c & 0xF]};
+        if (c == '\n') {
+            buffer.append("\\n", 2);
+        }
+        else if (c == '\r') {
+            buffer.append("\\r", 2);
+        }
+        else if (c == '\t') {
+            buffer.append("\\t", 2);
+        }
+        else if (c == '\\') {
+            buffer.append("\\\\", 2);
+        }
+        else {
+            buffer.append(escape, sizeof(escape));
+        }
+        ++str;
+    }
+}
+
+#undef LOGGER_SANITIZE_AVX2
+
+void Logger::_appendString(std::string& buffer, const Format::Operation& operation, const char* str,
+                           bool isSanitized) {
+    if (str == NULL) {
+        str = "(null)";
+    }
+    std::size_t size;
+    if (operation.precision >= 0) {
+        const char* end = static_cast<const char*>(::memchr(str, '\0', operation.precision));
+        size = (end == NULL) ? static_cast<std::size_t>(operation.precision) : static_cast<std::size_t>(end - str);
+    }
+    else {
+        size = ::strlen(str);
+    }
+    std::size_t width = static_cast<std::size_t>(operation.width);
+    if (isSanitized) {
+        // width of the escaped string
+        std::size_t start = buffer.size();
+        sanitize(buffer, str, size);
+        std::size_t length = buffer.size() - start;
+        if (width > length) {
+            if (operation.isLeftAlign) {
+                buffer.append(width - length, ' ');
+            }
+            else {
+                buffer.insert(start, width - length, ' ');
+            }
+        }
+        return;
+    }
+    if (width > size && !operation.isLeftAlign) {
+        buffer.append(width - size, ' ');
+    }
+    buffer.append(str, size);
+    if (width > size && operation.isLeftAlign) {
+        buffer.append(width - size, ' ');
+    }
+}
+
+void Logger::_appendInteger(std::string& buffer, const Format::Operation& operation, long value) {
+    if (operation.conversion != 'd' && operation.conversion != 'i' && operation.conversion != 'u') {
+        // other conversions are rendered by snprintf
+        char str[64];
+        int size = ::snprintf(str, sizeof(str), operation.printfFormat.c_str(), value);
+        if (size > 0) {
+            buffer.append(str, (static_cast<std::size_t>(size) < sizeof(str)) ? size : sizeof(str) - 1);
+        }
+        return;
+    }
+    // write digits from the end
+    char digits[32];
+    char* end = digits + sizeof(digits);
+    char* start = end;
+    unsigned long absValue = (value < 0) ? -static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+    while (absValue > 0) {
+        *--start = static_cast<char>('0' + absValue % 10);
+        absValue /= 10;
+    }
+    std::size_t size = end - start;
+    std::size_t zeros = 0;
+    if (operation.precision >= 0) {
+        if (static_cast<std::size_t>(operation.precision) > size) {
+            zeros = operation.precision - size;
+        }
+    }
+    else if (size == 0) {
+        zeros = 1;
+    }
+    char sign = (value < 0) ? '-' : operation.sign;
+    std::size_t totalSize = size + zeros + (sign != '\0' ? 1 : 0);
+    std::size_t width = static_cast<std::size_t>(operation.width);
+    std::size_t fill = (width > totalSize) ? width - totalSize : 0;
+    if (fill > 0 && !operation.isLeftAlign && (operation.padding != '0' || operation.precision >= 0)) {
+        buffer.append(fill, ' ');
+        fill = 0;
+    }
+    if (sign != '\0') {
+        buffer.push_back(sign);
+    }
+    if (fill > 0 && !operation.isLeftAlign) {
+        // padding with zero after the sign
+        zeros += fill;
+        fill = 0;
+    }
+    buffer.append(zeros, '0');
+    buffer.append(start, size);
+    if (fill > 0) {
+        buffer.append(fill, ' ');
+    }
+}
+
+// replace the seconds in the rendered minute
+#define LOGGER_SECOND_MARKER "\x01\x02"
+
+/**
+ * @brief Convert a time to a broken-down time without the timezone lock of localtime_r.
+ */
+static void s_timeToTm(time_t time, struct tm& tm) {
+    long days = static_cast<long>(time / 86400);
+    long seconds = static_cast<long>(time % 86400);
+    if (seconds < 0) {
+        seconds += 86400;
+        --days;
+    }
+    tm.tm_hour = static_cast<int>(seconds / 3600);
+    tm.tm_min = static_cast<int>(seconds / 60 % 60);
+    tm.tm_sec = static_cast<int>(seconds % 60);
+    // 1970-01-01 is a thursday
+    tm.tm_wday = static_cast<int>((days % 7 + 11) % 7);
+    // civil from days (http://howardhinnant.github.io/date_algorithms.html)
+    long z = days + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    long month = mp < 10 ? mp + 3 : mp - 9;
+    long year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+    tm.tm_mday = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    tm.tm_mon = static_cast<int>(month - 1);
+    tm.tm_year = static_cast<int>(year - 1900);
+    // day of year from march to january
+    bool isLeap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    tm.tm_yday = static_cast<int>(doy >= 306 ? doy - 306 : doy + 59 + (isLeap ? 1 : 0));
+}
+
+void Logger::_compileTime(Format::Operation& operation, const std::string& specifier) {
+    operation.str = specifier;
+    if (specifier.compare(0, 7, "iso8601") == 0) {
+        operation.isIso8601 = true;
+        operation.str = "%Y-%m-%dT%H:%M:%S";
+        operation.precision = 0;
+        if (specifier.size() > 8 && specifier[7] == '.') {
+            operation.precision = ::atoi(specifier.c_str() + 8);
+            if (operation.precision > 9) {
+                operation.precision = 9;
+            }
+        }
+    }
+    // these conversions can change each second without %S
+    static const char* const notPatchables[] = {"%s", "%X", "%c", "%r", "%+", "%E", "%O", "%N"};
+    operation.isPatchable = true;
+    for (std::size_t i = 0; i < sizeof(notPatchables) / sizeof(*notPatchables); ++i) {
+        if (operation.str.find(notPatchables[i]) != std::string::npos) {
+            operation.isPatchable = false;
+        }
+    }
+    if (!operation.isPatchable) {
+        return;
+    }
+    // replace the seconds by a marker
+    operation.patchFormat.clear();
+    for (std::size_t i = 0; i < operation.str.size(); ++i) {
+        if (operation.str[i] == '%' && i + 1 < operation.str.size()) {
+            switch (operation.str[i + 1]) {
+                case 'S':
+                    operation.patchFormat.append(LOGGER_SECOND_MARKER);
+                    break;
+                case 'T':
+                    operation.patchFormat.append("%H:%M:" LOGGER_SECOND_MARKER);
+                    break;
+                default:
+                    operation.patchFormat.append(operation.str, i, 2);
+                    break;
+            }
+            ++i;
+        }
+        else {
+            operation.patchFormat.push_back(operation.str[i]);
+        }
+    }
+}
+
+void Logger::_appendTime(std::string& buffer, const Format::Operation& operation, const struct timespec& ts,
+                         Format::TimeCache& cache) {
+    time_t second = ts.tv_sec;
+    if (!cache.isSecondValid || cache.second != second) {
+        // update the UTC offset by quarter hour
+        if (operation.isUtc) {
+            if (cache.zone == NULL) {
+                cache.zone = "UTC";
+                cache.isoOffset = "Z";
+            }
+        }
+        else if (cache.zone == NULL || second < cache.offsetStart || second >= cache.offsetEnd) {
+            struct tm t;
+            localtime_r(&second, &t);
+            cache.offsetStart = second - ((second % 900) + 900) % 900;
+            cache.offsetEnd = cache.offsetStart + 900;
+            if (cache.zone == NULL || cache.offset != t.tm_gmtoff || cache.isDst != t.tm_isdst) {
+                cache.isMinuteValid = false;
+            }
+            cache.offset = t.tm_gmtoff;
+            cache.zone = t.tm_zone;
+            cache.isDst = t.tm_isdst;
+            long offset = (cache.offset < 0) ? -cache.offset : cache.offset;
+            char isoOffset[8];
+            ::snprintf(isoOffset, sizeof(isoOffset), "%c%02ld:%02ld", (cache.offset < 0) ? '-' : '+',
+                       offset / 3600 % 100, offset / 60 % 60);
+            cache.isoOffset = isoOffset;
+        }
+        time_t local = second + cache.offset;
+        time_t minute = local / 60 - ((local % 60 < 0) ? 1 : 0);
+        if (!operation.isPatchable || !cache.isMinuteValid || cache.minute != minute) {
+            struct tm t;
+            s_timeToTm(local, t);
+            t.tm_isdst = cache.isDst;
+            t.tm_gmtoff = cache.offset;
+            t.tm_zone = cache.zone;
+            const std::string& format = operation.isPatchable ? operation.patchFormat : operation.str;
+            char ftime[256];
+            std::size_t size = strftime(ftime, sizeof(ftime), format.c_str(), &t);
+            cache.minuteRendered.assign(ftime, size);
+            cache.secondIndexes.clear();
+            if (operation.isPatchable) {
+                std::size_t index = cache.minuteRendered.find(LOGGER_SECOND_MARKER);
+                while (index != std::string::npos) {
+                    cache.secondIndexes.push_back(index);
+                    index = cache.minuteRendered.find(LOGGER_SECOND_MARKER, index + 2);
+                }
+            }
+            cache.minute = minute;
+            cache.isMinuteValid = true;
+        }
+        // patch the seconds digits
+        cache.rendered = cache.minuteRendered;
+        int seconds = static_cast<int>(local - minute * 60);
+        for (std::size_t i = 0; i < cache.secondIndexes.size(); ++i) {
+            cache.rendered[cache.secondIndexes[i]] = static_cast<char>('0' + seconds / 10);
+            cache.rendered[cache.secondIndexes[i] + 1] = static_cast<char>('0' + seconds % 10);
+        }
+        cache.second = second;
+        cache.isSecondValid = true;
+    }
+    buffer.append(cache.rendered);
+    if (operation.isIso8601) {
+        if (operation.precision > 0) {
+            char fraction[16];
+            fraction[0] = '.';
+            long nsec = ts.tv_nsec;
+            for (int i = 9; i > 0; --i) {
+                if (i <= operation.precision) {
+                    fraction[i] = static_cast<char>('0' + nsec % 10);
+                }
+                nsec /= 10;
+            }
+            buffer.append(fraction, operation.precision + 1);
+        }
+        buffer.append(cache.isoOffset);
+    }
+}
+
+#undef LOGGER_SECOND_MARKER
+
+void Logger::_renderMessage(std::string& buffer, const Message& message, bool isCached) const {
+    _renderMessage(buffer, *_levelFormat(message.level), message, isCached, isSanitized());
+}
+
+void Logger::_renderMessage(std::string& buffer, const Format& format, const Message& message, bool isCached,
+                            bool isSanitized) {
+    std::vector<Format::Operation>::const_iterator it;
+    for (it = format.operations.begin(); it != format.operations.end(); ++it) {
+        switch (it->type) {
+            case Format::Operation::LITERAL:
+                buffer.append(it->str);
+                break;
+            case Format::Operation::PATH:
+                _appendString(buffer, *it, message.file);
+                break;
+            case Format::Operation::FILENAME:
+                _appendString(buffer, *it, message.filename);
+                break;
+            case Format::Operation::LINE:
+                _appendInteger(buffer, *it, message.line);
+                break;
+            case Format::Operation::FUNCTION:
+                _appendString(buffer, *it, message.function);
+                break;
+            case Format::Operation::TIME:
+                if (isCached) {
+                    _appendTime(buffer, *it, message.ts, it->timeCache);
+                }
+                else {
+                    Format::TimeCache cache;
+                    _appendTime(buffer, *it, message.ts, cache);
+                }
+                break;
+            case Format::Operation::MESSAGE:
+                _appendString(buffer, *it, message.message, isSanitized);
+                break;
+            case Format::Operation::DECIMAL:
+                _appendInteger(buffer, *it, message.ts.tv_nsec / it->nsecDivisor);
+                break;
+        }
+    }
+    buffer.push_back('\n');
+}
+
+void Logger::printMessage(Logger::Message& message) const {
+    std::string buffer;
+    buffer.reserve(256);
+    // the formats are changed by setName and setTypeFormat
+    pthread_mutex_lock(&const_cast<Logger*>(this)->_logMutex);
+    _renderMessage(buffer, message, false);
+    pthread_mutex_unlock(&const_cast<Logger*>(this)->_logMutex);
+    FILE* file = _fileSink.getFILE();
+    if (file != NULL) {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+    }
+}
+
+void Logger::_threadRingRelease(void* ring) {
+    // the thread is exited, the ring will be deleted by _threadLog when it is empty
+    __atomic_store_n(&static_cast<Ring*>(ring)->isReleased, true, __ATOMIC_RELEASE);
+}
+
+Logger::Ring* Logger::_ringRegister() {
+    Ring* ring = new Ring();
+    if (_backend != NULL) {
+        try {
+            _backend->_threadRingAdd(_backendId, ring);
+        }
+        catch (const Exception&) {
+            delete ring;
+            throw;
+        }
+    }
+    else if (pthread_setspecific(_ringKey, ring)) {
+        delete ring;
+        throw Exception("pthread_setspecific: ", strerror(errno));
+    }
+    // push front without lock
+    ring->next = __atomic_load_n(&_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return ring;
+}
+
+static int64_t s_clockGetTime(clockid_t clockId) {
+    struct timespec ts;
+    clock_gettime(clockId, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t Logger::_clockNow(eClock clock) {
+    switch (clock) {
+        case REALTIME_CLOCK:
+            break;
+        case REALTIME_COARSE_CLOCK:
+            return static_cast<uint64_t>(s_clockGetTime(CLOCK_REALTIME_COARSE));
+        case MONOTONIC_RAW_CLOCK:
+            return static_cast<uint64_t>(s_clockGetTime(CLOCK_MONOTONIC_RAW));
+        case TSC_CLOCK:
+#if defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+        {
+            uint64_t ticks;
+            __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+            return ticks;
+        }
+#else
+            return static_cast<uint64_t>(s_clockGetTime(CLOCK_MONOTONIC_RAW));
+#endif
+    }
+    return static_cast<uint64_t>(s_clockGetTime(CLOCK_REALTIME));
+}
+
+void Logger::_clockSample(eClock clock, int64_t& real, uint64_t& raw, int64_t& error) {
+    // keep the narrowest window of realtime around the raw clock
+    error = -1;
+    for (int i = 0; i < 8; ++i) {
+        int64_t start = s_clockGetTime(CLOCK_REALTIME);
+        uint64_t tmpRaw = _clockNow(clock);
+        int64_t end = s_clockGetTime(CLOCK_REALTIME);
+        if (error < 0 || (end - start) / 2 < error) {
+            error = (end - start) / 2;
+            real = start + (end - start) / 2;
+            raw = tmpRaw;
+        }
+    }
+}
+
+Logger::ClockCalibration Logger::_clockCalibrate(eClock clock) {
+    ClockCalibration calibration;
+    if (clock == REALTIME_CLOCK || clock == REALTIME_COARSE_CLOCK) {
+        struct timespec resolution;
+        clock_getres((clock == REALTIME_CLOCK) ? CLOCK_REALTIME : CLOCK_REALTIME_COARSE, &resolution);
+        calibration.error = static_cast<int64_t>(resolution.tv_sec) * 1000000000 + resolution.tv_nsec;
+        return calibration;
+    }
+    int64_t startError;
+    int64_t endError;
+    _clockSample(clock, calibration.realStart, calibration.rawStart, startError);
+    // measure the frequency on 20 milliseconds
+    struct timespec sleepTime = {0, 20000000};
+    nanosleep(&sleepTime, NULL);
+    _clockSample(clock, calibration.realBase, calibration.rawBase, endError);
+    calibration.nsecPerTick = static_cast<double>(calibration.realBase - calibration.realStart) /
+                              static_cast<double>(calibration.rawBase - calibration.rawStart);
+    // error of the last sample and error of frequency during the second before the next calibration
+    calibration.error = endError + (startError + endError) * 1000000000 / (calibration.realBase - calibration.realStart);
+    calibration.lastCalibration = s_clockGetTime(CLOCK_MONOTONIC);
+    return calibration;
+}
+
+void Logger::_clockRecalibrate() {
+    eClock clock = static_cast<eClock>(__atomic_load_n(&_clock, __ATOMIC_ACQUIRE));
+    pthread_mutex_lock(&_logMutex);
+    if (_threadClockCalibration.generation != _clockCalibration.generation) {
+        _threadClockCalibration = _clockCalibration;
+    }
+    pthread_mutex_unlock(&_logMutex);
+    if ((clock != MONOTONIC_RAW_CLOCK && clock != TSC_CLOCK) ||
+        s_clockGetTime(CLOCK_MONOTONIC) - _threadClockCalibration.lastCalibration < 1000000000) {
+        return;
+    }
+    // new base and frequency from the first calibration
+    ClockCalibration calibration(_threadClockCalibration);
+    int64_t error;
+    _clockSample(clock, calibration.realBase, calibration.rawBase, error);
+    calibration.nsecPerTick = static_cast<double>(calibration.realBase - calibration.realStart) /
+                              static_cast<double>(calibration.rawBase - calibration.rawStart);
+    calibration.lastCalibration = s_clockGetTime(CLOCK_MONOTONIC);
+    _threadClockCalibration = calibration;
+}
+
+int64_t Logger::_clockToRealtime(eClock clock, uint64_t stamp) const {
+    if (clock == REALTIME_CLOCK || clock == REALTIME_COARSE_CLOCK) {
+        return static_cast<int64_t>(stamp);
+    }
+    const ClockCalibration& calibration = _threadClockCalibration;
+    // stamp can be older than the base
+    double ticks = (stamp >= calibration.rawBase) ? static_cast<double>(stamp - calibration.rawBase)
+                                                  : -static_cast<double>(calibration.rawBase - stamp);
+    return calibration.realBase + static_cast<int64_t>(ticks * calibration.nsecPerTick);
+}
+
+void Logger::setClock(eClock clock) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (clock == TSC_CLOCK) {
+        unsigned int eax = 0x80000007;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        unsigned int edx = 0;
+        __asm__ __volatile__("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        // invariant TSC bit
+        if ((edx & (1u << 8)) == 0) {
+            throw Exception("setClock: ", "time stamp counter is not invariant");
+        }
+    }
+#endif
+    ClockCalibration calibration = _clockCalibrate(clock);
+    pthread_mutex_lock(&_logMutex);
+    calibration.generation = _clockCalibration.generation + 1;
+    _clockCalibration = calibration;
+    pthread_mutex_unlock(&_logMutex);
+    // publish the clock after its calibration
+    __atomic_store_n(&_clock, static_cast<int>(clock), __ATOMIC_RELEASE);
+}
+
+int64_t Logger::getClockError() const {
+    pthread_mutex_lock(&const_cast<Logger*>(this)->_logMutex);
+    int64_t error = _clockCalibration.error;
+    pthread_mutex_unlock(&const_cast<Logger*>(this)->_logMutex);
+    return error;
+}
+
+void Logger::_ringsDrain() {
+    Ring* ring;
+    // snapshot of messages available in each ring
+    for (ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        ring->take();
+    }
+    // the calibration of clock is published before the messages of snapshot
+    _clockRecalibrate();
+    _sinksUpdate();
+    // render messages of all rings ordered by timestamp, only the ring of the last message is pushed again
+    std::greater<std::pair<int64_t, Ring*> > isGreater;
+    _drainHeap.clear();
+    for (ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int64_t stamp;
+        if (_ringHead(ring, stamp)) {
+            _drainHeap.push_back(std::make_pair(stamp, ring));
+        }
+    }
+    std::make_heap(_drainHeap.begin(), _drainHeap.end(), isGreater);
+    while (!_drainHeap.empty()) {
+        std::pop_heap(_drainHeap.begin(), _drainHeap.end(), isGreater);
+        Ring* older = _drainHeap.back().second;
+        int64_t olderStamp = _drainHeap.back().first;
+        _drainHeap.pop_back();
+        if (_sinksBufferSize >= LOGGER_OUTPUT_BATCH_SIZE) {
+            _sinksWrite();
+        }
+        Record* record = older->at(older->tail);
+        record->message.ts.tv_sec = static_cast<time_t>(olderStamp / 1000000000);
+        record->message.ts.tv_nsec = static_cast<long>(olderStamp % 1000000000);
+        if (record->message.ts.tv_nsec < 0) {
+            record->message.ts.tv_nsec += 1000000000;
+            --record->message.ts.tv_sec;
+        }
+        if (record->dropped > 0) {
+            // the ring is recovered
+            char droppedMessage[64];
+            snprintf(droppedMessage, sizeof(droppedMessage), "%lu messages dropped", record->dropped);
+            Message message;
+            message.level = WARNING;
+            message.file = "";
+            message.filename = "";
+            message.line = 0;
+            message.function = "";
+            message.ts = record->message.ts;
+            message.message = droppedMessage;
+            _sinksRender(message, NULL);
+        }
+        if (record->render != NULL) {
+            // formated by _sinksRender
+            record->message.message = NULL;
+        }
+        _sinksRender(record->message, record);
+        delete[] record->outOfLine;
+#ifdef LOGGER_PERF_DEBUG
+        ++_messagePrinted;
+#endif
+        older->release(record->size);
+        int64_t stamp;
+        if (_ringHead(older, stamp)) {
+            _drainHeap.push_back(std::make_pair(stamp, older));
+            std::push_heap(_drainHeap.begin(), _drainHeap.end(), isGreater);
+        }
+    }
+    _sinksWrite();
+    // the released records are visible before the read of the waiting flags
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // delete empty rings of exited threads
+    Ring* prev = NULL;
+    ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE);
+    while (ring != NULL) {
+        Ring* next = ring->next;
+        if (__atomic_load_n(&ring->isProducerWaiting, __ATOMIC_RELAXED) != 0) {
+            ring->wakeProducer();
+        }
+        if (!__atomic_load_n(&ring->isReleased, __ATOMIC_ACQUIRE) ||
+            Ring::cursorTail(__atomic_load_n(&ring->cursor, __ATOMIC_ACQUIRE)) !=
+                __atomic_load_n(&ring->publishedHead, __ATOMIC_ACQUIRE)) {
+            prev = ring;
+            ring = next;
+            continue;
+        }
+        if (prev != NULL) {
+            prev->next = next;
+        }
+        else {
+            Ring* expected = ring;
+            if (!__atomic_compare_exchange_n(&_rings, &expected, next, false, __ATOMIC_ACQ_REL,
+                                             __ATOMIC_ACQUIRE)) {
+                // new rings was pushed in front, search the previous of ring
+                prev = expected;
+                while (prev->next != ring) {
+                    prev = prev->next;
+                }
+                prev->next = next;
+            }
+        }
+        delete ring;
+        ring = next;
+    }
+}
+
+bool Logger::_ringHead(Ring* ring, int64_t& stamp) {
+    if (ring->tail == ring->drainHead) {
+        return false;
+    }
+    Record* record = ring->at(ring->tail);
+    if (record->isPadding) {
+        ring->release(record->size);
+        if (ring->tail == ring->drainHead) {
+            return false;
+        }
+        record = ring->at(ring->tail);
+    }
+    stamp = _clockToRealtime(record->clock, record->stamp);
+    return true;
+}
+
+void Logger::_sinksUpdate() {
+    pthread_mutex_lock(&_logMutex);
+    if (_threadSinksGeneration != _sinksGeneration) {
+        _threadSinks = _sinks;
+        _threadSinksGeneration = _sinksGeneration;
+        // the formats are rebuilt by setName and setTypeFormat
+        for (int level = EMERGENCY; level <= DEBUG; ++level) {
+            _threadFormats[level] = *_levelFormat(static_cast<eLevel>(level));
+        }
+        _threadName = _name;
+        for (std::vector<SinkEntry*>::iterator it = _threadSinks.begin(); it != _threadSinks.end(); ++it) {
+            (*it)->threadFormats = (*it)->formats;
+            for (std::size_t i = 0; i < (*it)->fields.size(); ++i) {
+                (*it)->fields[i].threadFormats = (*it)->fields[i].formats;
+            }
+        }
+    }
+    pthread_mutex_unlock(&_logMutex);
+}
+
+void Logger::_sinksRender(Message& message, Record* record) {
+    std::vector<SinkEntry*>::iterator it = _threadSinks.begin();
+    while (it != _threadSinks.end()) {
+        if (!(*it)->isText()) {
+            if (message.level <= (*it)->level) {
+                if ((*it)->isBinary) {
+                    _binaryRender(**it, message, record);
+                }
+                else {
+                    _structuredRender(**it, message, record);
+                }
+                _sinksBufferSize = std::max(_sinksBufferSize, (*it)->buffer.size());
+            }
+            ++it;
+            continue;
+        }
+        // entries with the same format
+        std::vector<SinkEntry*>::iterator end = it + 1;
+        while (end != _threadSinks.end() && SinkEntry::isFormatEqual(*it, *end)) {
+            ++end;
+        }
+        SinkEntry* target = NULL;
+        std::size_t targetCount = 0;
+        for (std::vector<SinkEntry*>::iterator entry = it; entry != end; ++entry) {
+            if (message.level <= (*entry)->level) {
+                target = *entry;
+                ++targetCount;
+            }
+        }
+        if (targetCount > 0) {
+            if (record != NULL && record->render != NULL && message.message == NULL) {
+                // format the deferred arguments only for the text sinks
+                _render(record);
+            }
+            const Format& format = (*it)->hasFormat ? (*it)->threadFormats[message.level] : _threadFormats[message.level];
+            if (targetCount == 1) {
+                if (target->isIndexed) {
+                    target->sink->index(message, target->buffer.size());
+                }
+                _renderMessage(target->buffer, format, message, true, isSanitized());
+                _sinksBufferSize = std::max(_sinksBufferSize, target->buffer.size());
+            }
+            else {
+                // render once for all sinks
+                _outputBuffer.clear();
+                _renderMessage(_outputBuffer, format, message, true, isSanitized());
+                for (std::vector<SinkEntry*>::iterator entry = it; entry != end; ++entry) {
+                    if (message.level <= (*entry)->level) {
+                        if ((*entry)->isIndexed) {
+                            (*entry)->sink->index(message, (*entry)->buffer.size());
+                        }
+                        (*entry)->buffer.append(_outputBuffer);
+                        _sinksBufferSize = std::max(_sinksBufferSize, (*entry)->buffer.size());
+                    }
+                }
+            }
+        }
+        it = end;
+    }
+}
+
+static void s_appendUnsigned(std::string& buffer, uint64_t value) {
+    char digits[20];
+    char* it = digits + sizeof(digits);
+    do {
+        *--it = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    buffer.append(it, digits + sizeof(digits) - it);
+}
+
+static void s_appendSigned(std::string& buffer, int64_t value) {
+    if (value < 0) {
+        buffer.push_back('-');
+        s_appendUnsigned(buffer, 0 - static_cast<uint64_t>(value));
+    }
+    else {
+        s_appendUnsigned(buffer, static_cast<uint64_t>(value));
+    }
+}
+
+/**
+ * @brief Append a number of snprintf with a '.' for the decimal point of LC_NUMERIC.
+ */
+static void s_appendNumber(std::string& buffer, const char* str, int size) {
+    const char* end = str + size;
+    while (str != end) {
+        if ((*str >= '0' && *str <= '9') || *str == '-' || *str == '+' || *str == 'e') {
+            buffer.push_back(*str++);
+            continue;
+        }
+        // decimal point of locale (one or more bytes)
+        buffer.push_back('.');
+        while (str != end && !(*str >= '0' && *str <= '9')) {
+            ++str;
+        }
+    }
+}
+
+/**
+ * @brief Shortest of 15 or 17 (6 or 9 for a float) significant digits which reads back the same value.
+ * snprintf and strtod use the same LC_NUMERIC, the decimal point is replaced by '.'.
+ */
+static void s_appendFloating(std::string& buffer, double value, bool isJson, bool isFloat = false) {
+    if (value != value) {
+        buffer.append(isJson ? "null" : "NaN");
+        return;
+    }
+    if (value > DBL_MAX || value < -DBL_MAX) {
+        buffer.append(isJson ? "null" : (value < 0 ? "-Inf" : "+Inf"));
+        return;
+    }
+    if (value > -1e15 && value < 1e15 && value == static_cast<double>(static_cast<int64_t>(value))) {
+        s_appendSigned(buffer, static_cast<int64_t>(value));
+        return;
+    }
+    char str[32];
+    if (isFloat) {
+        int size = snprintf(str, sizeof(str), "%.6g", value);
+        if (static_cast<float>(strtod(str, NULL)) != static_cast<float>(value)) {
+            size = snprintf(str, sizeof(str), "%.9g", value);
+        }
+        s_appendNumber(buffer, str, size);
+        return;
+    }
+    int size = snprintf(str, sizeof(str), "%.15g", value);
+    if (strtod(str, NULL) != value) {
+        size = snprintf(str, sizeof(str), "%.17g", value);
+    }
+    s_appendNumber(buffer, str, size);
+}
+
+/**
+ * @brief Append str with the JSON escapes of quote, backslash and control characters,
+ * a byte of an invalid UTF-8 sequence is replaced by \ufffd.
+ */
+static void s_appendEscaped(std::string& buffer, const char* str, std::size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    const char* begin = str;
+    const char* end = str + size;
+    for (; str != end; ++str) {
+        unsigned char c = static_cast<unsigned char>(*str);
+        if (c >= 0x80) {
+            std::size_t length =
+                s_utf8Length(reinterpret_cast<const unsigned char*>(str), reinterpret_cast<const unsigned char*>(end));
+            if (length > 0) {
+                str += length - 1;
+            }
+            else {
+                buffer.append(begin, str - begin);
+                begin = str + 1;
+                buffer.append("\\ufffd");
+            }
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        buffer.append(begin, str - begin);
+        begin = str + 1;
+        buffer.push_back('\\');
+        switch (c) {
+            case '"':
+            case '\\':
+                buffer.push_back(static_cast<char>(c));
+                break;
+            case '\n':
+                buffer.push_back('n');
+                break;
+            case '\r':
+                buffer.push_back('r');
+                break;
+            case '\t':
+                buffer.push_back('t');
+                break;
+            case '\b':
+                buffer.push_back('b');
+                break;
+            case '\f':
+                buffer.push_back('f');
+                break;
+            default:
+                buffer.append("u00");
+                buffer.push_back(hex[c >> 4]);
+                buffer.push_back(hex[c & 0xF]);
+                break;
+        }
+    }
+    buffer.append(begin, end - begin);
+}
+
+/**
+ * @brief Append a string value, quoted in JSON or in logfmt when it is empty or has a special character.
+ */
+static void s_appendString(std::string& buffer, bool isJson, const char* str, std::size_t size) {
+    bool isQuoted = isJson || size == 0;
+    for (std::size_t i = 0; i < size && !isQuoted; ++i) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        isQuoted = c <= ' ' || c == '"' || c == '=' || c == '\\';
+        if (c >= 0x80) {
+            // quoted and escaped if it is not UTF-8
+            std::size_t length = s_utf8Length(reinterpret_cast<const unsigned char*>(str + i),
+                                              reinterpret_cast<const unsigned char*>(str + size));
+            isQuoted = length == 0;
+            i += (length > 0) ? length - 1 : 0;
+        }
+    }
+    if (isQuoted) {
+        buffer.push_back('"');
+        s_appendEscaped(buffer, str, size);
+        buffer.push_back('"');
+    }
+    else {
+        buffer.append(str, size);
+    }
+}
+
+static void s_appendKey(std::string& buffer, bool isJson, bool isFirst, const char* key, std::size_t size) {
+    if (isJson) {
+        buffer.append(isFirst ? "\"" : ",\"");
+        s_appendEscaped(buffer, key, size);
+        buffer.append("\":");
+    }
+    else {
+        if (!isFirst) {
+            buffer.push_back(' ');
+        }
+        if (size == 0) {
+            buffer.push_back('_');
+        }
+        // a logfmt key is not quoted, the separators and invalid bytes are replaced by '_'
+        const char* end = key + size;
+        while (key != end) {
+            unsigned char c = static_cast<unsigned char>(*key);
+            std::size_t length = 1;
+            if (c >= 0x80) {
+                length = s_utf8Length(reinterpret_cast<const unsigned char*>(key),
+                                      reinterpret_cast<const unsigned char*>(end));
+            }
+            if (length == 0 || c <= ' ' || c == '"' || c == '=' || c == '\\' || c == 0x7F) {
+                buffer.push_back('_');
+                ++key;
+            }
+            else {
+                buffer.append(key, length);
+                key += length;
+            }
+        }
+        buffer.push_back('=');
+    }
+}
+
+/**
+ * @brief Read a value of the deferred arguments.
+ */
+template<typename T>
+static bool s_readArgument(const char*& args, const char* argsEnd, T& value) {
+    if (args + sizeof(T) > argsEnd) {
+        return false;
+    }
+    memcpy(&value, args, sizeof(T));
+    args += sizeof(T);
+    return true;
+}
+
+/**
+ * @brief Read a C string of the deferred arguments (null flag and string).
+ */
+static bool s_readFieldString(const char*& args, const char* argsEnd, const char*& value, std::size_t& size) {
+    if (args >= argsEnd) {
+        return false;
+    }
+    value = NULL;
+    size = 0;
+    if (*args++ != '\0') {
+        const char* end = static_cast<const char*>(memchr(args, '\0', argsEnd - args));
+        if (end == NULL) {
+            return false;
+        }
+        value = args;
+        size = end - args;
+        args = end + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Append the key value fields of structuredLog, each field is preceded by its separator.
+ *
+ * @param signature codes of the deferred arguments, a key code is followed by a value code.
+ */
+static void s_appendFields(std::string& buffer, Logger::eStructuredFormat encoding, const char* signature,
+                           const char* args, const char* argsEnd) {
+    bool isJson = encoding == Logger::JSON_STRUCTURED;
+    for (; signature[0] == 's' && signature[1] != '\0'; signature += 2) {
+        const char* key;
+        std::size_t keySize;
+        if (!s_readFieldString(args, argsEnd, key, keySize) || key == NULL) {
+            return;
+        }
+        s_appendKey(buffer, isJson, false, key, keySize);
+        bool isValid = true;
+        switch (signature[1]) {
+            case 'b': {
+                signed char value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendSigned(buffer, value);
+                }
+                break;
+            }
+            case 'h': {
+                short value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendSigned(buffer, value);
+                }
+                break;
+            }
+            case 'i': {
+                int value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendSigned(buffer, value);
+                }
+                break;
+            }
+            case 'l': {
+                int64_t value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendSigned(buffer, value);
+                }
+                break;
+            }
+            case 'B': {
+                unsigned char value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendUnsigned(buffer, value);
+                }
+                break;
+            }
+            case 'H': {
+                unsigned short value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendUnsigned(buffer, value);
+                }
+                break;
+            }
+            case 'I': {
+                unsigned int value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendUnsigned(buffer, value);
+                }
+                break;
+            }
+            case 'L': {
+                uint64_t value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendUnsigned(buffer, value);
+                }
+                break;
+            }
+            case 't': {
+                bool value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    buffer.append(value ? "true" : "false");
+                }
+                break;
+            }
+            case 'f': {
+                float value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendFloating(buffer, value, isJson, true);
+                }
+                break;
+            }
+            case 'd': {
+                double value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendFloating(buffer, value, isJson);
+                }
+                break;
+            }
+            case 'D': {
+                long double value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendFloating(buffer, static_cast<double>(value), isJson);
+                }
+                break;
+            }
+            case 'p': {
+                const void* value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    char str[32];
+                    int size = snprintf(str, sizeof(str), "%p", value);
+                    s_appendString(buffer, isJson, str, size);
+                }
+                break;
+            }
+            case 's': {
+                const char* value;
+                std::size_t size;
+                if ((isValid = s_readFieldString(args, argsEnd, value, size))) {
+                    if (value != NULL) {
+                        s_appendString(buffer, isJson, value, size);
+                    }
+                    else if (isJson) {
+                        buffer.append("null");
+                    }
+                }
+                break;
+            }
+            default:
+                isValid = false;
+                break;
+        }
+        if (!isValid) {
+            return;
+        }
+    }
+}
+
+static void s_appendVarint(std::string& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+static void s_appendBytes(std::string& buffer, const char* str, std::size_t size) {
+    s_appendVarint(buffer, size);
+    buffer.append(str, size);
+}
+
+static void s_appendBytes(std::string& buffer, const char* str) {
+    if (str == NULL) {
+        str = "";
+    }
+    s_appendBytes(buffer, str, ::strlen(str));
+}
+
+void Logger::_binaryRender(SinkEntry& entry, const Message& message, const Record* record) {
+    std::string& buffer = entry.buffer;
+    std::size_t offset = buffer.size();
+    if (!entry.isHeaderWritten) {
+        buffer.append(LOGGER_BINARY_MAGIC, sizeof(LOGGER_BINARY_MAGIC) - 1);
+        entry.isHeaderWritten = true;
+    }
+    _binaryRecord(entry, message, record);
+    if (entry.sink->split(offset, buffer.size() - offset)) {
+        // the new file starts by the header of stream and the delta of the first timestamp is from 0
+        buffer.resize(offset);
+        buffer.append(LOGGER_BINARY_MAGIC, sizeof(LOGGER_BINARY_MAGIC) - 1);
+        if (!entry.name.empty()) {
+            buffer.push_back(static_cast<char>(BINARY_NAME_TAG));
+            s_appendBytes(buffer, entry.name.data(), entry.name.size());
+        }
+        buffer.append(entry.dictionary);
+        entry.lastStamp = 0;
+        _binaryRecord(entry, message, record);
+    }
+}
+
+void Logger::_binaryRecord(SinkEntry& entry, const Message& message, const Record* record) {
+    std::string& buffer = entry.buffer;
+    if (entry.name != _threadName) {
+        buffer.push_back(static_cast<char>(BINARY_NAME_TAG));
+        s_appendBytes(buffer, _threadName.data(), _threadName.size());
+        entry.name = _threadName;
+    }
+    bool isDeferred = record != NULL && record->render != NULL;
+    SinkEntry::Site site;
+    site.file = message.file;
+    site.filename = message.filename;
+    site.function = message.function;
+    site.format = isDeferred ? record->format : NULL;
+    site.signature = isDeferred ? record->signature : NULL;
+    site.line = message.line;
+    site.level = message.level;
+    std::map<SinkEntry::Site, unsigned long>::iterator it = entry.sites.find(site);
+    if (it == entry.sites.end()) {
+        // new call site
+        it = entry.sites.insert(std::make_pair(site, static_cast<unsigned long>(entry.sites.size()))).first;
+        std::string& dictionary = entry.dictionary;
+        std::size_t siteOffset = dictionary.size();
+        dictionary.push_back(static_cast<char>(BINARY_SITE_TAG));
+        s_appendVarint(dictionary, it->second);
+        dictionary.push_back(static_cast<char>(message.level));
+        // 0: text, 1: deferred arguments, 2: structured fields
+        dictionary.push_back(static_cast<char>(isDeferred ? (record->render == &_renderStructured ? 2 : 1) : 0));
+        s_appendBytes(dictionary, site.file);
+        s_appendBytes(dictionary, site.filename);
+        s_appendVarint(dictionary, static_cast<uint64_t>(site.line));
+        s_appendBytes(dictionary, site.function);
+        s_appendBytes(dictionary, site.format);
+        s_appendBytes(dictionary, site.signature);
+        buffer.append(dictionary, siteOffset, std::string::npos);
+    }
+    int64_t stamp = static_cast<int64_t>(message.ts.tv_sec) * 1000000000 + message.ts.tv_nsec;
+    int64_t delta = stamp - entry.lastStamp;
+    entry.lastStamp = stamp;
+    buffer.push_back(static_cast<char>(BINARY_MESSAGE_TAG));
+    s_appendVarint(buffer, it->second);
+    // zigzag of delta
+    s_appendVarint(buffer, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    if (isDeferred) {
+        const char* payload =
+            (record->outOfLine != NULL) ? record->outOfLine : reinterpret_cast<const char*>(record + 1);
+        s_appendBytes(buffer, payload, record->payloadSize);
+    }
+    else {
+        s_appendBytes(buffer, message.message);
+    }
+}
+
+/**
+ * @brief Append a printf conversion with its '*' width and precision.
+ */
+template<typename T>
+static void s_appendConversion(std::string& output, const std::string& spec, const int* stars, int starCount,
+                               T value) {
+    char buffer[256];
+    char* str = buffer;
+    std::vector<char> bigBuffer;
+    std::size_t capacity = sizeof(buffer);
+    for (;;) {
+        int size;
+        if (starCount == 2) {
+            size = snprintf(str, capacity, spec.c_str(), stars[0], stars[1], value);
+        }
+        else if (starCount == 1) {
+            size = snprintf(str, capacity, spec.c_str(), stars[0], value);
+        }
+        else {
+            size = snprintf(str, capacity, spec.c_str(), value);
+        }
+        if (size < 0) {
+            return;
+        }
+        if (static_cast<std::size_t>(size) < capacity) {
+            output.append(str, size);
+            return;
+        }
+        bigBuffer.resize(size + 1);
+        str = &bigBuffer[0];
+        capacity = bigBuffer.size();
+    }
+}
+
+/**
+ * @brief Skip a deferred argument of signature code.
+ */
+static bool s_skipArgument(char code, const char*& args, const char* argsEnd) {
+    std::size_t size;
+    switch (code) {
+        case 'b':
+        case 'B':
+        case 't':
+            size = sizeof(char);
+            break;
+        case 'h':
+        case 'H':
+            size = sizeof(short);
+            break;
+        case 'i':
+        case 'I':
+            size = sizeof(int);
+            break;
+        case 'l':
+        case 'L':
+            size = sizeof(int64_t);
+            break;
+        case 'f':
+            size = sizeof(float);
+            break;
+        case 'd':
+            size = sizeof(double);
+            break;
+        case 'D':
+            size = sizeof(long double);
+            break;
+        case 'p':
+            size = sizeof(const void*);
+            break;
+        case 's': {
+            const char* value;
+            return s_readFieldString(args, argsEnd, value, size);
+        }
+        default:
+            return false;
+    }
+    if (static_cast<std::size_t>(argsEnd - args) < size) {
+        return false;
+    }
+    args += size;
+    return true;
+}
+
+/**
+ * @brief Append the deferred argument of signature code with a printf conversion.
+ *
+ * @param spec flags, width and precision of conversion, the length is chosen by the code.
+ * @return false if the conversion is not compatible with the code or if the argument is truncated.
+ */
+static bool s_appendArgument(std::string& output, std::string& spec, const int* stars, int starCount,
+                             char conversion, char code, const char* args, const char* argsEnd) {
+    bool isValid = true;
+    switch (code) {
+        case 'b':
+        case 'B':
+        case 't':
+        case 'h':
+        case 'H':
+        case 'i':
+        case 'I': {
+            if (strchr("diouxXc", conversion) == NULL) {
+                return false;
+            }
+            spec.push_back(conversion);
+            int value = 0;
+            if (code == 'b') {
+                signed char v;
+                isValid = s_readArgument(args, argsEnd, v);
+                value = v;
+            }
+            else if (code == 'B' || code == 't') {
+                unsigned char v;
+                isValid = s_readArgument(args, argsEnd, v);
+                value = v;
+            }
+            else if (code == 'h') {
+                short v;
+                isValid = s_readArgument(args, argsEnd, v);
+                value = v;
+            }
+            else if (code == 'H') {
+                unsigned short v;
+                isValid = s_readArgument(args, argsEnd, v);
+                value = v;
+            }
+            else if (code == 'i') {
+                isValid = s_readArgument(args, argsEnd, value);
+            }
+            else {
+                unsigned int v;
+                if ((isValid = s_readArgument(args, argsEnd, v))) {
+                    s_appendConversion(output, spec, stars, starCount, v);
+                }
+                break;
+            }
+            if (isValid) {
+                s_appendConversion(output, spec, stars, starCount, value);
+            }
+            break;
+        }
+        case 'l':
+        case 'L': {
+            if (strchr("diouxX", conversion) == NULL) {
+                return false;
+            }
+            spec.push_back('j');
+            spec.push_back(conversion);
+            if (code == 'l') {
+                int64_t value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendConversion(output, spec, stars, starCount, static_cast<intmax_t>(value));
+                }
+            }
+            else {
+                uint64_t value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendConversion(output, spec, stars, starCount, static_cast<uintmax_t>(value));
+                }
+            }
+            break;
+        }
+        case 'f':
+        case 'd':
+        case 'D': {
+            if (strchr("fFeEgGaA", conversion) == NULL) {
+                return false;
+            }
+            if (code == 'D') {
+                spec.push_back('L');
+                spec.push_back(conversion);
+                long double value;
+                if ((isValid = s_readArgument(args, argsEnd, value))) {
+                    s_appendConversion(output, spec, stars, starCount, value);
+                }
+                break;
+            }
+            spec.push_back(conversion);
+            double value;
+            if (code == 'f') {
+                float v;
+                isValid = s_readArgument(args, argsEnd, v);
+                value = v;
+            }
+            else {
+                isValid = s_readArgument(args, argsEnd, value);
+            }
+            if (isValid) {
+                s_appendConversion(output, spec, stars, starCount, value);
+            }
+            break;
+        }
+        case 'p': {
+            if (conversion != 'p') {
+                return false;
+            }
+            spec.push_back(conversion);
+            const void* value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_appendConversion(output, spec, stars, starCount, value);
+            }
+            break;
+        }
+        case 's': {
+            if (conversion != 's') {
+                return false;
+            }
+            spec.push_back(conversion);
+            // null flag and C string
+            const char* value;
+            std::size_t size;
+            if ((isValid = s_readFieldString(args, argsEnd, value, size))) {
+                s_appendConversion(output, spec, stars, starCount, value);
+            }
+            break;
+        }
+        default:
+            isValid = false;
+            break;
+    }
+    return isValid;
+}
+
+/**
+ * @brief Read the position "n$" of a printf argument.
+ *
+ * @param index index of argument (n - 1).
+ * @return false and i is not moved if there is no position.
+ */
+static bool s_readPosition(const std::string& format, std::size_t& i, std::size_t& index) {
+    std::size_t end = i;
+    std::size_t position = 0;
+    while (end < format.size() && format[end] >= '0' && format[end] <= '9' && position < 10000) {
+        position = position * 10 + static_cast<std::size_t>(format[end++] - '0');
+    }
+    if (end == i || end >= format.size() || format[end] != '$' || position == 0) {
+        return false;
+    }
+    index = position - 1;
+    i = end + 1;
+    return true;
+}
+
+/**
+ * @brief Format the raw deferred arguments of payload with the codes of signature.
+ *
+ * @return false if the format is not compatible with the signature or the payload.
+ */
+static bool s_binaryFormat(std::string& output, const std::string& format, const std::string& signature,
+                           const std::string& payload) {
+    const char* argsEnd = payload.data() + payload.size();
+    // offsets of the arguments, the positional conversions read them in any order
+    std::vector<const char*> offsets;
+    offsets.reserve(signature.size());
+    const char* args = payload.data();
+    for (std::size_t i = 0; i < signature.size(); ++i) {
+        const char* arg = args;
+        if (!s_skipArgument(signature[i], args, argsEnd)) {
+            break;
+        }
+        offsets.push_back(arg);
+    }
+    // next argument of the conversions without position
+    std::size_t next = 0;
+    std::string spec;
+    std::size_t i = 0;
+    while (i < format.size()) {
+        if (format[i] != '%') {
+            output.push_back(format[i++]);
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            output.push_back('%');
+            i += 2;
+            continue;
+        }
+        // %[n$][flags][width][.precision][length]conversion, the positions and the length are removed of spec
+        ++i;
+        std::size_t index;
+        bool isPositional = s_readPosition(format, i, index);
+        spec.assign(1, '%');
+        int stars[2];
+        int starCount = 0;
+        while (i < format.size() && strchr("-+ #0'123456789.*hlLqjzt", format[i]) != NULL) {
+            if (format[i] == '*') {
+                ++i;
+                std::size_t starIndex;
+                if (!s_readPosition(format, i, starIndex)) {
+                    starIndex = next++;
+                }
+                if (starCount == 2 || starIndex >= offsets.size() || signature[starIndex] != 'i') {
+                    return false;
+                }
+                const char* star = offsets[starIndex];
+                s_readArgument(star, argsEnd, stars[starCount++]);
+                spec.push_back('*');
+                continue;
+            }
+            if (strchr("hlLqjzt", format[i]) == NULL) {
+                spec.push_back(format[i]);
+            }
+            ++i;
+        }
+        if (!isPositional) {
+            index = next++;
+        }
+        if (i >= format.size() || index >= offsets.size()) {
+            return false;
+        }
+        char conversion = format[i++];
+        if (!s_appendArgument(output, spec, stars, starCount, conversion, signature[index], offsets[index],
+                              argsEnd)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-// printf(FORMAT, level, name, path, file, line, func, pid, time, message)
+Logger::BinaryReader::BinaryReader(FILE* file) :
+    _file(file),
+    _isHeaderRead(false),
+    _offset(0),
+    _stamp(0) {}
 
-#define LOGGER_OPEN_BRACE  static_cast<char>(-41)
-#define LOGGER_SEPARATOR   static_cast<char>(-42)
-#define LOGGER_CLOSE_BRACE static_cast<char>(-43)
+int Logger::BinaryReader::_readByte() {
+    int c = getc(_file);
+    if (c == EOF) {
+        throw Exception("BinaryReader: ", "truncated stream");
+    }
+    return c;
+}
 
-namespace blet {
+uint64_t Logger::BinaryReader::_readVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = _readByte();
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw Exception("BinaryReader: ", "invalid varint");
+}
 
-Logger::Logger() :
-    name(""),
-    _isStarted(true),
-    _currentMessageId(0),
-    _messages(new Message[LOGGER_QUEUE_SIZE]),
-    _messagesSwap(new Message[LOGGER_QUEUE_SIZE]) {
-    // default file
-    _pfile = stdout;
-    // default format
-    setAllFormat(LOGGER_DEFAULT_FORMAT);
-    // init thread
-    if (pthread_mutex_init(&_logMutex, NULL)) {
-        throw Exception("pthread_mutex_init: ", strerror(errno));
+void Logger::BinaryReader::_readBytes(std::string& str) {
+    uint64_t size = _readVarint();
+    str.clear();
+    // the size is not trusted, the string grows only with the read bytes
+    while (str.size() < size) {
+        std::size_t offset = str.size();
+        std::size_t chunk = static_cast<std::size_t>(std::min<uint64_t>(size - offset, 65536));
+        str.resize(offset + chunk);
+        if (fread(&str[offset], 1, chunk, _file) != chunk) {
+            throw Exception("BinaryReader: ", "truncated stream");
+        }
     }
-    if (pthread_cond_init(&_condLog, NULL)) {
-        throw Exception("pthread_cond_init: ", strerror(errno));
+}
+
+bool Logger::BinaryReader::next(Message& message) {
+    if (!_isHeaderRead) {
+        char magic[sizeof(LOGGER_BINARY_MAGIC) - 1];
+        std::size_t size = fread(magic, 1, sizeof(magic), _file);
+        if (size == 0) {
+            return false;
+        }
+        if (size != sizeof(magic) || memcmp(magic, LOGGER_BINARY_MAGIC, sizeof(magic)) != 0) {
+            throw Exception("BinaryReader: ", "invalid magic");
+        }
+        _isHeaderRead = true;
+    }
+    for (;;) {
+        int tag = getc(_file);
+        if (tag == EOF) {
+            return false;
+        }
+        if (tag == LOGGER_BINARY_MAGIC[0]) {
+            // header of the next file (split or concatenated streams)
+            char magic[sizeof(LOGGER_BINARY_MAGIC) - 2];
+            if (fread(magic, 1, sizeof(magic), _file) != sizeof(magic) ||
+                memcmp(magic, LOGGER_BINARY_MAGIC + 1, sizeof(magic)) != 0) {
+                throw Exception("BinaryReader: ", "invalid magic");
+            }
+            _name.clear();
+            _sites.clear();
+            _stamp = 0;
+        }
+        else if (tag == BINARY_NAME_TAG) {
+            _readBytes(_name);
+        }
+        else if (tag == BINARY_SITE_TAG) {
+            uint64_t id = _readVarint();
+            if (id != _sites.size()) {
+                throw Exception("BinaryReader: ", "invalid site");
+            }
+            Site site;
+            site.level = static_cast<eLevel>(_readByte() & 7);
+            int payloadType = _readByte();
+            site.isDeferred = payloadType != 0;
+            site.isStructured = payloadType == 2;
+            _readBytes(site.file);
+            _readBytes(site.filename);
+            site.line = static_cast<int>(_readVarint());
+            _readBytes(site.function);
+            _readBytes(site.format);
+            _readBytes(site.signature);
+            _sites.push_back(site);
+        }
+        else if (tag == BINARY_MESSAGE_TAG) {
+            uint64_t id = _readVarint();
+            if (id >= _sites.size()) {
+                throw Exception("BinaryReader: ", "unknown site");
+            }
+            uint64_t zigzag = _readVarint();
+            _stamp += static_cast<int64_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+            _readBytes(_payload);
+            const Site& site = _sites[id];
+            if (site.isStructured) {
+                _message = site.format;
+                s_appendFields(_message, LOGFMT_STRUCTURED, site.signature.c_str(), _payload.data(),
+                               _payload.data() + _payload.size());
+            }
+            else if (site.isDeferred) {
+                _message.clear();
+                if (!s_binaryFormat(_message, site.format, site.signature, _payload)) {
+                    throw Exception("BinaryReader: ", "invalid format");
+                }
+            }
+            else {
+                _message.assign(_payload.c_str());
+            }
+            message.level = site.level;
+            message.file = site.file.c_str();
+            message.filename = site.filename.c_str();
+            message.line = site.line;
+            message.function = site.function.c_str();
+            message.ts.tv_sec = static_cast<time_t>(_stamp / 1000000000);
+            message.ts.tv_nsec = static_cast<long>(_stamp % 1000000000);
+            if (message.ts.tv_nsec < 0) {
+                message.ts.tv_nsec += 1000000000;
+                --message.ts.tv_sec;
+            }
+            message.message = _message.c_str();
+            _offset = ftell(_file);
+            return true;
+        }
+        else {
+            throw Exception("BinaryReader: ", "invalid tag");
+        }
+    }
+}
+
+void Logger::addBinarySink(Sink* sink, eLevel level) {
+    SinkEntry* entry = new SinkEntry(sink, level, NULL, true);
+    pthread_mutex_lock(&_logMutex);
+    std::vector<SinkEntry*>::iterator it =
+        std::upper_bound(_sinks.begin(), _sinks.end(), entry, &SinkEntry::isFormatLess);
+    _sinks.insert(it, entry);
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
+}
+
+void Logger::_structuredRender(SinkEntry& entry, const Message& message, const Record* record) {
+    std::string& buffer = entry.buffer;
+    bool isJson = entry.encoding == JSON_STRUCTURED;
+    if (isJson) {
+        buffer.push_back('{');
     }
-    if (sem_init(&_queueSemaphore, 0, 0)) {
-        throw Exception("sem_init: ", strerror(errno));
+    bool isFirst = true;
+    for (std::vector<SinkEntry::Field>::iterator it = entry.fields.begin(); it != entry.fields.end(); ++it) {
+        _fieldBuffer.clear();
+        _renderMessage(_fieldBuffer, it->threadFormats[message.level], message, true, false);
+        if (!_fieldBuffer.empty() && _fieldBuffer[_fieldBuffer.size() - 1] == '\n') {
+            // end of line of _renderMessage
+            _fieldBuffer.erase(_fieldBuffer.size() - 1);
+        }
+        s_appendKey(buffer, isJson, isFirst, it->key.data(), it->key.size());
+        if (it->isNumber) {
+            buffer.append(_fieldBuffer);
+        }
+        else {
+            s_appendString(buffer, isJson, _fieldBuffer.data(), _fieldBuffer.size());
+        }
+        isFirst = false;
     }
-    if (pthread_create(&_threadLogId, NULL, &_threadLogger, this)) {
-        throw Exception("pthread_create: ", strerror(errno));
+    s_appendKey(buffer, isJson, isFirst, "message", sizeof("message") - 1);
+    if (record != NULL && record->render == &_renderStructured) {
+        s_appendString(buffer, isJson, record->format, ::strlen(record->format));
+        const char* payload =
+            (record->outOfLine != NULL) ? record->outOfLine : reinterpret_cast<const char*>(record + 1);
+        s_appendFields(buffer, entry.encoding, record->signature, payload, payload + record->payloadSize);
     }
+    else {
+        if (record != NULL && record->render != NULL && message.message == NULL) {
+            // format the deferred arguments
+            _render(const_cast<Record*>(record));
+        }
+        s_appendString(buffer, isJson, message.message, ::strlen(message.message));
+    }
+    buffer.append(isJson ? "}\n" : "\n");
+}
 
-#ifdef LOGGER_PERF_DEBUG
-    clock_gettime(CLOCK_MONOTONIC, &_startTs);
-    _messageCount = 0;
-    _messagePrinted = 0;
-#endif
+void Logger::addStructuredSink(Sink* sink, eLevel level, eStructuredFormat encoding, const char* fields) {
+    SinkEntry* entry = new SinkEntry(sink, level, NULL);
+    entry->isStructured = true;
+    entry->encoding = encoding;
+    // {key}{key:specifier}...
+    std::string str(fields != NULL ? fields : "");
+    // the name is rendered in the formats
+    pthread_mutex_lock(&_logMutex);
+    std::size_t start = str.find('{');
+    while (start != std::string::npos) {
+        std::size_t end = str.find('}', start);
+        if (end == std::string::npos) {
+            break;
+        }
+        SinkEntry::Field field;
+        field.format = str.substr(start, end - start + 1);
+        std::size_t separator = str.find(':', start);
+        field.key = str.substr(start + 1, std::min(separator, end) - start - 1);
+        field.isNumber = (field.key == "line" || field.key == "pid") && separator > end;
+        if (field.key != "message") {
+            static const eLevel levels[] = {EMERGENCY, ALERT, CRITICAL, ERROR, WARNING, NOTICE, INFO, DEBUG};
+            field.formats.resize(sizeof(levels) / sizeof(*levels));
+            for (std::size_t i = 0; i < sizeof(levels) / sizeof(*levels); ++i) {
+                field.formats[levels[i]] = _formatContructor(field.format.c_str(), _name, levels[i]);
+            }
+            entry->fields.push_back(field);
+        }
+        start = str.find('{', end);
+    }
+    std::vector<SinkEntry*>::iterator it =
+        std::upper_bound(_sinks.begin(), _sinks.end(), entry, &SinkEntry::isFormatLess);
+    _sinks.insert(it, entry);
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
 }
 
-Logger::~Logger() {
-    _isStarted = false;
-    // unlock thread
-    sem_post(&_queueSemaphore);
-    pthread_join(_threadLogId, NULL);
-    // delete messageQueue
-    delete[] _messages;
-    delete[] _messagesSwap;
+void Logger::_sinksWrite() {
+    for (std::vector<SinkEntry*>::iterator it = _threadSinks.begin(); it != _threadSinks.end(); ++it) {
+        if (!(*it)->buffer.empty()) {
+            (*it)->sink->write((*it)->buffer.data(), (*it)->buffer.size());
+            (*it)->buffer.clear();
+        }
+    }
+    _sinksBufferSize = 0;
+}
 
-#ifdef LOGGER_PERF_DEBUG
-    timespec endTs;
-    clock_gettime(CLOCK_MONOTONIC, &endTs);
-    if ((endTs.tv_nsec - _startTs.tv_nsec) < 0) {
-        endTs.tv_nsec = 1000000000 + (endTs.tv_nsec - _startTs.tv_nsec);
-        endTs.tv_sec -= 1;
+void Logger::_sinksFlush() {
+    for (std::vector<SinkEntry*>::iterator it = _threadSinks.begin(); it != _threadSinks.end(); ++it) {
+        (*it)->sink->flush();
+    }
+}
+
+void Logger::_sinksSync() {
+    for (std::vector<SinkEntry*>::iterator it = _threadSinks.begin(); it != _threadSinks.end(); ++it) {
+        (*it)->sink->sync();
+    }
+}
+
+void Logger::_syncWait() {
+    unsigned long sequence = __atomic_add_fetch(&_syncSequence, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&_logMutex);
+    _wakeUp(true);
+    while (static_cast<long>(_syncedSequence - sequence) < 0 && __atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&_condLog, &_logMutex);
+    }
+    pthread_mutex_unlock(&_logMutex);
+}
+
+void Logger::setDurable(eLevel level, bool isDurable) {
+    if (isDurable) {
+        __atomic_or_fetch(&_durableLevels, 1 << level, __ATOMIC_RELAXED);
     }
     else {
-        endTs.tv_nsec = endTs.tv_nsec - _startTs.tv_nsec;
+        __atomic_and_fetch(&_durableLevels, ~(1 << level), __ATOMIC_RELAXED);
     }
-    fprintf(stderr, "LOGGER_PERF %s:\n", name.c_str());
-    fprintf(stderr, "- Time: %ld.%09ld\n", (endTs.tv_sec - _startTs.tv_sec), endTs.tv_nsec);
-    fprintf(stderr, "- Message counted: %u\n", _messageCount);
-    fprintf(stderr, "- Message printed: %u\n", _messagePrinted);
-    fprintf(stderr, "- Message rate: %f\n", _messagePrinted / ((endTs.tv_sec - _startTs.tv_sec) * 1000000000.0 + endTs.tv_nsec) * 1000000000);
-    fflush(stderr);
-#endif
 }
 
-void Logger::flush() {
-    int semValue = 1;
-    while (_isStarted && semValue > 0) {
-        pthread_mutex_lock(&_logMutex);
-        sem_getvalue(&_queueSemaphore, &semValue);
-        if (semValue == 0) {
-            sem_post(&_queueSemaphore);
+void Logger::addSink(Sink* sink, eLevel level, const char* format) {
+    SinkEntry* entry = new SinkEntry(sink, level, format);
+    // the name is rendered in the formats
+    pthread_mutex_lock(&_logMutex);
+    if (format != NULL) {
+        static const eLevel levels[] = {EMERGENCY, ALERT, CRITICAL, ERROR, WARNING, NOTICE, INFO, DEBUG};
+        entry->formats.resize(sizeof(levels) / sizeof(*levels));
+        for (std::size_t i = 0; i < sizeof(levels) / sizeof(*levels); ++i) {
+            entry->formats[levels[i]] = _formatContructor(format, _name, levels[i]);
         }
-        pthread_cond_wait(&_condLog, &_logMutex);
-        pthread_mutex_unlock(&_logMutex);
     }
-    fflush(_pfile);
+    std::vector<SinkEntry*>::iterator it =
+        std::upper_bound(_sinks.begin(), _sinks.end(), entry, &SinkEntry::isFormatLess);
+    _sinks.insert(it, entry);
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
 }
 
-void* Logger::_threadLogger(void* e) {
-    Logger* loggin = static_cast<Logger*>(e);
-    loggin->_threadLog();
-    return NULL;
+void Logger::removeSink(Sink* sink) {
+    std::vector<SinkEntry*> removed;
+    pthread_mutex_lock(&_logMutex);
+    std::vector<SinkEntry*>::iterator it = _sinks.begin();
+    while (it != _sinks.end()) {
+        if ((*it)->sink == sink) {
+            removed.push_back(*it);
+            it = _sinks.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
+    // the next drain of logger thread uses the new sinks
+    flush();
+    for (it = removed.begin(); it != removed.end(); ++it) {
+        delete *it;
+    }
 }
 
-void Logger::printMessage(Logger::Message& message) const {
-    static char ftime[128];
+int Logger::_renderStructured(char* buffer, std::size_t size, const char* /*format*/, const char* /*args*/) {
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+    return 0;
+}
 
-    const char* strLevel = NULL;
-    const Format* format = &_format;
-    switch (message.level) {
-        case EMERGENCY:
-            strLevel = "EMERG";
-            format = &_emergencyFormat;
-            break;
-        case ALERT:
-            strLevel = "ALERT";
-            format = &_alertFormat;
-            break;
-        case CRITICAL:
-            strLevel = "CRIT";
-            format = &_criticalFormat;
-            break;
-        case ERROR:
-            strLevel = "ERROR";
-            format = &_errorFormat;
-            break;
-        case WARNING:
-            strLevel = "WARN";
-            format = &_warningFormat;
-            break;
-        case NOTICE:
-            strLevel = "NOTICE";
-            format = &_noticeFormat;
-            break;
-        case INFO:
-            strLevel = "INFO";
-            format = &_infoFormat;
-            break;
-        case DEBUG:
-            strLevel = "DEBUG";
-            format = &_debugFormat;
-            break;
+void Logger::_render(Record* record) {
+    const char* payload = (record->outOfLine != NULL) ? record->outOfLine : reinterpret_cast<char*>(record + 1);
+    if (record->render == &_renderStructured) {
+        // message followed by the fields in logfmt
+        _structuredMessage = record->format;
+        s_appendFields(_structuredMessage, LOGFMT_STRUCTURED, record->signature, payload,
+                       payload + record->payloadSize);
+        record->message.message = _structuredMessage.c_str();
+        return;
+    }
+    int size = record->render(&_renderBuffer[0], _renderBuffer.size(), record->format, payload);
+    if (size < 0) {
+        _renderBuffer[0] = '\0';
     }
+    else if (static_cast<std::size_t>(size) >= _renderBuffer.size()) {
+        // keep the biggest buffer for next messages
+        _renderBuffer.resize(size + 1);
+        record->render(&_renderBuffer[0], _renderBuffer.size(), record->format, payload);
+    }
+    record->message.message = _renderBuffer.c_str();
+}
 
-    if (format->hasTime) {
-        struct tm t;
-        localtime_r(&(message.ts.tv_sec), &t);
-        strftime(ftime, 128, format->time.c_str(), &t);
+void Logger::_wakeUp(bool isRequested) {
+    if (isRequested) {
+        __atomic_store_n(&_isWakeRequested, true, __ATOMIC_RELAXED);
     }
-    else {
-        ftime[0] = '\0';
+    // the published messages are visible before the read of the sleeping flag
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int* isSleeping = (_worker != NULL) ? &_worker->isSleeping : &_isSleeping;
+    if (__atomic_load_n(isSleeping, __ATOMIC_RELAXED) != 0 && __atomic_exchange_n(isSleeping, 0, __ATOMIC_ACQ_REL) != 0) {
+        syscall(SYS_futex, isSleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+bool Logger::_hasWork() {
+    if (__atomic_load_n(&_isWakeRequested, __ATOMIC_RELAXED) || !__atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    for (Ring* ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        if (__atomic_load_n(&ring->publishedHead, __ATOMIC_ACQUIRE) != ring->drainHead) {
+            return true;
+        }
     }
+    return false;
+}
 
-    fprintf(_pfile, format->str.c_str(),
-            name.c_str(),
-            strLevel,
-            message.file,
-            message.filename,
-            message.line,
-            message.function,
-            format->pid,
-            ftime,
-            message.message,
-            message.ts.tv_nsec / format->nsecDivisor);
+void Logger::_waitWork() {
+    for (int i = 0; i < LOGGER_WAKEUP_SPIN; ++i) {
+        if (_hasWork()) {
+            return;
+        }
+        sched_yield();
+    }
+    __atomic_store_n(&_isSleeping, 1, __ATOMIC_RELAXED);
+    // the sleeping flag is visible before the check of messages
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (_hasWork()) {
+        __atomic_store_n(&_isSleeping, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    while (__atomic_load_n(&_isSleeping, __ATOMIC_ACQUIRE) != 0) {
+        syscall(SYS_futex, &_isSleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+    long batchDelay = __atomic_load_n(&_batchDelay, __ATOMIC_RELAXED);
+    if (batchDelay > 0 && !__atomic_load_n(&_isWakeRequested, __ATOMIC_RELAXED)) {
+        // wait more messages for a bigger batch
+        struct timespec delay;
+        delay.tv_sec = batchDelay / 1000000;
+        delay.tv_nsec = (batchDelay % 1000000) * 1000;
+        nanosleep(&delay, NULL);
+    }
 }
 
 void Logger::_threadLog() {
-    unsigned int lastMessageId;
-    int semValue = 1;
-    while (_isStarted || semValue > 0) {
-        sem_wait(&_queueSemaphore);
-        pthread_mutex_lock(&_logMutex);
-        if (_currentMessageId == 0) {
-            sem_getvalue(&_queueSemaphore, &semValue);
-            pthread_mutex_unlock(&_logMutex);
-            pthread_cond_signal(&_condLog);
+    bool isStarted = true;
+    while (isStarted) {
+        _waitWork();
+        isStarted = __atomic_load_n(&_isStarted, __ATOMIC_ACQUIRE);
+        _threadWork();
+    }
+}
+
+void Logger::_threadWork() {
+    __atomic_store_n(&_isWakeRequested, false, __ATOMIC_SEQ_CST);
+    // the messages enqueued before these flush and sync requests are in the drain
+    unsigned long flushSequence = __atomic_load_n(&_flushSequence, __ATOMIC_SEQ_CST);
+    unsigned long syncSequence = __atomic_load_n(&_syncSequence, __ATOMIC_SEQ_CST);
+    _ringsDrain();
+    bool isFlushed = flushSequence != _writtenSequence;
+    bool isSynced = syncSequence != _syncedSequence;
+    if (!isFlushed && !isSynced) {
+        return;
+    }
+    if (isSynced) {
+        // one sync for all the durable messages of drain
+        _sinksSync();
+    }
+    else {
+        _sinksFlush();
+    }
+    pthread_mutex_lock(&_logMutex);
+    __atomic_store_n(&_writtenSequence, flushSequence, __ATOMIC_RELEASE);
+    _syncedSequence = syncSequence;
+    FlushCallback flushCallback = _flushCallback;
+    void* flushUserData = _flushUserData;
+    pthread_mutex_unlock(&_logMutex);
+    pthread_cond_broadcast(&_condLog);
+    if (isFlushed) {
+        // notify the event loops
+        int flushFd = __atomic_load_n(&_flushFd, __ATOMIC_ACQUIRE);
+        uint64_t event = 1;
+        while (flushFd >= 0 && write(flushFd, &event, sizeof(event)) < 0 && errno == EINTR) {
+        }
+        if (flushCallback != NULL) {
+            flushCallback(flushSequence, flushUserData);
+        }
+    }
+}
+
+Logger::Backend::Backend(std::size_t threadCount) :
+    _nextLoggerId(0) {
+    if (pthread_mutex_init(&_mutex, NULL)) {
+        throw Exception("pthread_mutex_init: ", strerror(errno));
+    }
+    if (pthread_cond_init(&_condWorker, NULL)) {
+        pthread_mutex_destroy(&_mutex);
+        throw Exception("pthread_cond_init: ", strerror(errno));
+    }
+    if (pthread_key_create(&_ringKey, &_threadRingsRelease)) {
+        int error = errno;
+        pthread_cond_destroy(&_condWorker);
+        pthread_mutex_destroy(&_mutex);
+        throw Exception("pthread_key_create: ", strerror(error));
+    }
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        Worker* worker = new Worker(this);
+        if (pthread_create(&worker->threadId, NULL, &_threadWorker, worker)) {
+            int error = errno;
+            delete worker;
+            _stop();
+            throw Exception("pthread_create: ", strerror(error));
+        }
+        _workers.push_back(worker);
+    }
+}
+
+Logger::Backend::~Backend() {
+    _stop();
+}
+
+void Logger::Backend::_stop() {
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        __atomic_store_n(&_workers[i]->isStarted, false, __ATOMIC_RELEASE);
+        // unlock thread
+        __atomic_store_n(&_workers[i]->isSleeping, 0, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &_workers[i]->isSleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        pthread_join(_workers[i]->threadId, NULL);
+        delete _workers[i];
+    }
+    _workers.clear();
+    // the rings of the loggers are deleted with their logger
+    pthread_key_delete(_ringKey);
+    for (std::size_t i = 0; i < _threadRings.size(); ++i) {
+        delete _threadRings[i];
+    }
+    _threadRings.clear();
+    pthread_cond_destroy(&_condWorker);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void* Logger::Backend::_threadWorker(void* e) {
+    Worker* worker = static_cast<Worker*>(e);
+    pthread_mutex_lock(&worker->backend->_mutex);
+    worker->tid = static_cast<pid_t>(syscall(SYS_gettid));
+    pthread_mutex_unlock(&worker->backend->_mutex);
+    pthread_cond_broadcast(&worker->backend->_condWorker);
+    worker->backend->_threadRun(worker);
+    return NULL;
+}
+
+pid_t Logger::Backend::_threadTid(Worker* worker) {
+    pthread_mutex_lock(&_mutex);
+    // wait the start of thread
+    while (worker->tid == 0) {
+        pthread_cond_wait(&_condWorker, &_mutex);
+    }
+    pid_t tid = worker->tid;
+    pthread_mutex_unlock(&_mutex);
+    return tid;
+}
+
+void Logger::Backend::setThreadAffinity(const std::vector<int>& cpus) {
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        s_threadAffinity(_threadTid(_workers[i]), cpus);
+    }
+}
+
+void Logger::Backend::setThreadPriority(int policy, int priority) {
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        s_threadPriority(_threadTid(_workers[i]), policy, priority);
+    }
+}
+
+void Logger::Backend::setThreadName(const char* name) {
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        if (_workers.size() == 1) {
+            s_threadName(_workers[i]->threadId, name);
             continue;
         }
-        // swap messages
-        Message* tmp = _messages;
-        _messages = _messagesSwap;
-        _messagesSwap = tmp;
-        // save last message id
-        lastMessageId = _currentMessageId;
-        // reset current message id
-        _currentMessageId = 0;
-        pthread_mutex_unlock(&_logMutex);
-
-        // call print function
-        for (unsigned int i = 0; i < lastMessageId; ++i) {
-            printMessage(_messagesSwap[i]);
-#ifdef LOGGER_PERF_DEBUG
-            ++_messagePrinted;
-#endif
+        // keep the index in the 15 characters
+        char index[24];
+        std::size_t indexSize = static_cast<std::size_t>(
+            snprintf(index, sizeof(index), "-%lu", static_cast<unsigned long>(i)));
+        std::string threadName(name, std::min(strlen(name), 15 - indexSize));
+        threadName.append(index, indexSize);
+        s_threadName(_workers[i]->threadId, threadName.c_str());
+    }
+}
+
+void Logger::Backend::_threadRun(Worker* worker) {
+    for (;;) {
+        _waitWork(worker);
+        if (!__atomic_load_n(&worker->isStarted, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        pthread_mutex_lock(&_mutex);
+        if (worker->threadGeneration != worker->generation) {
+            worker->threadLoggers = worker->loggers;
+            worker->threadGeneration = worker->generation;
+            // the detached loggers are not used by this thread
+            pthread_cond_broadcast(&_condWorker);
+        }
+        pthread_mutex_unlock(&_mutex);
+        // a drain takes a snapshot of rings, the first logger of turn changes for the fairness
+        std::size_t count = worker->threadLoggers.size();
+        for (std::size_t i = 0; i < count; ++i) {
+            Logger* logger = worker->threadLoggers[(worker->next + i) % count];
+            if (logger->_hasWork()) {
+                logger->_threadWork();
+            }
+        }
+        if (count > 0) {
+            worker->next = (worker->next + 1) % count;
+        }
+    }
+}
+
+bool Logger::Backend::_hasWork(Worker* worker) {
+    if (!__atomic_load_n(&worker->isStarted, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&worker->generation, __ATOMIC_ACQUIRE) != worker->threadGeneration) {
+        return true;
+    }
+    for (std::size_t i = 0; i < worker->threadLoggers.size(); ++i) {
+        if (worker->threadLoggers[i]->_hasWork()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::Backend::_waitWork(Worker* worker) {
+    for (int i = 0; i < LOGGER_WAKEUP_SPIN; ++i) {
+        if (_hasWork(worker)) {
+            return;
+        }
+        sched_yield();
+    }
+    __atomic_store_n(&worker->isSleeping, 1, __ATOMIC_RELAXED);
+    // the sleeping flag is visible before the check of messages
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (_hasWork(worker)) {
+        __atomic_store_n(&worker->isSleeping, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    while (__atomic_load_n(&worker->isSleeping, __ATOMIC_ACQUIRE) != 0) {
+        syscall(SYS_futex, &worker->isSleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+Logger::Backend::Worker* Logger::Backend::_attach(Logger* logger) {
+    pthread_mutex_lock(&_mutex);
+    // thread with the fewest loggers
+    Worker* worker = _workers[0];
+    for (std::size_t i = 1; i < _workers.size(); ++i) {
+        if (_workers[i]->loggers.size() < worker->loggers.size()) {
+            worker = _workers[i];
+        }
+    }
+    worker->loggers.push_back(logger);
+    logger->_backendId = _nextLoggerId++;
+    __atomic_store_n(&worker->generation, worker->generation + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&_mutex);
+    return worker;
+}
+
+void Logger::Backend::_detach(Worker* worker, Logger* logger) {
+    pthread_mutex_lock(&_mutex);
+    worker->loggers.erase(std::find(worker->loggers.begin(), worker->loggers.end(), logger));
+    unsigned long generation = worker->generation + 1;
+    __atomic_store_n(&worker->generation, generation, __ATOMIC_RELEASE);
+    // the thread reads the new loggers at its wake up
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&worker->isSleeping, 0, __ATOMIC_ACQ_REL) != 0) {
+        syscall(SYS_futex, &worker->isSleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    while (static_cast<long>(worker->threadGeneration - generation) < 0) {
+        pthread_cond_wait(&_condWorker, &_mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool Logger::Backend::_isAttached(unsigned long loggerId) const {
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        const std::vector<Logger*>& loggers = _workers[i]->loggers;
+        for (std::size_t j = 0; j < loggers.size(); ++j) {
+            if (loggers[j]->_backendId == loggerId) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Logger::Ring* Logger::Backend::_threadRing(unsigned long loggerId) const {
+    const ThreadRings* threadRings = static_cast<const ThreadRings*>(pthread_getspecific(_ringKey));
+    if (threadRings == NULL) {
+        return NULL;
+    }
+    for (std::size_t i = 0; i < threadRings->rings.size(); ++i) {
+        if (threadRings->rings[i].first == loggerId) {
+            return threadRings->rings[i].second;
+        }
+    }
+    return NULL;
+}
+
+void Logger::Backend::_threadRingAdd(unsigned long loggerId, Ring* ring) {
+    ThreadRings* threadRings = static_cast<ThreadRings*>(pthread_getspecific(_ringKey));
+    pthread_mutex_lock(&_mutex);
+    if (threadRings == NULL) {
+        threadRings = new ThreadRings(this);
+        if (pthread_setspecific(_ringKey, threadRings)) {
+            int error = errno;
+            pthread_mutex_unlock(&_mutex);
+            delete threadRings;
+            throw Exception("pthread_setspecific: ", strerror(error));
+        }
+        _threadRings.push_back(threadRings);
+    }
+    // forget the rings of the destroyed loggers, the ids are not reused
+    std::vector<std::pair<unsigned long, Ring*> >& rings = threadRings->rings;
+    for (std::size_t i = 0; i < rings.size();) {
+        if (_isAttached(rings[i].first)) {
+            ++i;
+        }
+        else {
+            rings.erase(rings.begin() + i);
         }
+    }
+    rings.push_back(std::make_pair(loggerId, ring));
+    pthread_mutex_unlock(&_mutex);
+}
 
-        pthread_cond_broadcast(&_condLog);
+void Logger::Backend::_threadRingsRelease(void* e) {
+    ThreadRings* threadRings = static_cast<ThreadRings*>(e);
+    Backend* backend = threadRings->backend;
+    pthread_mutex_lock(&backend->_mutex);
+    for (std::size_t i = 0; i < threadRings->rings.size(); ++i) {
+        // the ring of a detached logger is deleted by its destructor
+        if (backend->_isAttached(threadRings->rings[i].first)) {
+            _threadRingRelease(threadRings->rings[i].second);
+        }
     }
+    backend->_threadRings.erase(
+        std::find(backend->_threadRings.begin(), backend->_threadRings.end(), threadRings));
+    pthread_mutex_unlock(&backend->_mutex);
+    delete threadRings;
 }
 
 static void s_formatSerialize(std::string& str) {
@@ -258,52 +4018,89 @@ static void s_formatDeserialize(std::string& str) {
     }
 }
 
-Logger::Format Logger::_formatContructor(const char* str) {
-    // initialize default format
-    std::map<std::string, std::string> emptyFormats;
-    emptyFormats["name"] = "%1$.0s";
-    emptyFormats["level"] = "%2$.0s";
-    emptyFormats["path"] = "%3$.0s";
-    emptyFormats["file"] = "%4$.0s";
-    emptyFormats["line"] = "%5$.0s";
-    emptyFormats["func"] = "%6$.0s";
-    emptyFormats["pid"] = "%7$.0s";
-    emptyFormats["time"] = "%8$.0s";
-    emptyFormats["message"] = "%9$.0s";
-    emptyFormats["decimal"] = "%10$.0s";
-    std::map<std::string, std::string> defaultFormats;
-    defaultFormats["name"] = "%1$s";
-    defaultFormats["level"] = "%2$s";
-    defaultFormats["path"] = "%3$s";
-    defaultFormats["file"] = "%4$s";
-    defaultFormats["line"] = "%5$d";
-    defaultFormats["func"] = "%6$s";
-    defaultFormats["pid"] = "%7$d";
-    defaultFormats["time"] = "%8$s";
-    defaultFormats["message"] = "%9$s";
-    defaultFormats["microsec"] = "%10$d";
-    defaultFormats["millisec"] = "%10$d";
-    defaultFormats["nanosec"] = "%10$d";
-    std::map<std::string, std::string> keyToid;
-    keyToid["name"] = "1$";
-    keyToid["level"] = "2$";
-    keyToid["path"] = "3$";
-    keyToid["file"] = "4$";
-    keyToid["line"] = "5$";
-    keyToid["func"] = "6$";
-    keyToid["pid"] = "7$";
-    keyToid["time"] = "8$";
-    keyToid["message"] = "9$";
-    keyToid["microsec"] = "10$";
-    keyToid["millisec"] = "10$";
-    keyToid["nanosec"] = "10$";
+/**
+ * @brief Parse a printf specifier "[prefix]%[flags][width][.precision][length]conversion[suffix]".
+ */
+void Logger::_parseSpecifier(const std::string& specifier, Format::Operation& operation, std::string& prefix,
+                             std::string& suffix) {
+    std::size_t index = specifier.find('%');
+    if (index == std::string::npos) {
+        prefix = specifier;
+        return;
+    }
+    prefix = specifier.substr(0, index);
+    std::size_t start = index++;
+    // flags
+    while (index < specifier.size() && ::strchr("-0+ #", specifier[index]) != NULL) {
+        switch (specifier[index]) {
+            case '-':
+                operation.isLeftAlign = true;
+                break;
+            case '0':
+                operation.padding = '0';
+                break;
+            case '+':
+                operation.sign = '+';
+                break;
+            case ' ':
+                if (operation.sign == '\0') {
+                    operation.sign = ' ';
+                }
+                break;
+        }
+        ++index;
+    }
+    // width
+    while (index < specifier.size() && specifier[index] >= '0' && specifier[index] <= '9') {
+        operation.width = operation.width * 10 + (specifier[index] - '0');
+        ++index;
+    }
+    // precision
+    if (index < specifier.size() && specifier[index] == '.') {
+        operation.precision = 0;
+        ++index;
+        while (index < specifier.size() && specifier[index] >= '0' && specifier[index] <= '9') {
+            operation.precision = operation.precision * 10 + (specifier[index] - '0');
+            ++index;
+        }
+    }
+    operation.printfFormat = specifier.substr(start, index - start);
+    // length modifier is ignored, value is a long
+    while (index < specifier.size() && ::strchr("hlLqjzt", specifier[index]) != NULL) {
+        ++index;
+    }
+    if (index < specifier.size()) {
+        operation.conversion = specifier[index];
+        ++index;
+        if (::strchr("diouxX", operation.conversion) != NULL) {
+            operation.printfFormat.push_back('l');
+        }
+        operation.printfFormat.push_back(operation.conversion);
+    }
+    suffix = specifier.substr(index);
+}
+
+void Logger::_appendLiteral(Format& format, const std::string& literal) {
+    if (literal.empty()) {
+        return;
+    }
+    // merge the following literals
+    if (!format.operations.empty() && format.operations.back().type == Format::Operation::LITERAL) {
+        format.operations.back().str.append(literal);
+    }
+    else {
+        Format::Operation operation(Format::Operation::LITERAL);
+        operation.str = literal;
+        format.operations.push_back(operation);
+    }
+}
 
+Logger::Format Logger::_formatContructor(const char* str, const std::string& name, eLevel level) {
     Format ret;
     ret.origin = str;
     // transform "{:}" non escape characters
     std::string format(str);
     s_formatSerialize(format);
-    std::list<std::string> formats;
     // search first occurence of '{'
     std::size_t lastIndexStart = 0;
     std::size_t indexStart = format.find(LOGGER_OPEN_BRACE);
@@ -316,296 +4113,809 @@ Logger::Format Logger::_formatContructor(const char* str) {
             break;
         }
         // substr the part before key
-        if (lastIndexStart - indexStart > 0) {
-            std::string beforeKey = format.substr(lastIndexStart, indexStart - lastIndexStart);
-            s_formatDeserialize(beforeKey);
-            formats.push_back(beforeKey);
-        }
+        std::string beforeKey = format.substr(lastIndexStart, indexStart - lastIndexStart);
+        s_formatDeserialize(beforeKey);
+        _appendLiteral(ret, beforeKey);
         lastIndexStart = indexEnd + 1;
         // search first occurrence of ':' after indexStart
         indexFormat = format.find(LOGGER_SEPARATOR, indexStart);
+        std::string key;
+        std::string specifier;
+        bool hasSpecifier = false;
         // if ':' not found or ':' is not between '{' and '}'
         if (indexFormat == std::string::npos || indexFormat > indexEnd) {
             // get name of key
-            std::string key = format.substr(indexStart + 1, indexEnd - indexStart - 1);
-            if (key == "name") {
-                formats.push_back(defaultFormats.at("name"));
-                emptyFormats.erase("name");
-            }
-            else if (key == "level") {
-                formats.push_back(defaultFormats.at("level"));
-                emptyFormats.erase("level");
-            }
-            else if (key == "path") {
-                formats.push_back(defaultFormats.at("path"));
-                emptyFormats.erase("path");
-            }
-            else if (key == "file") {
-                formats.push_back(defaultFormats.at("file"));
-                emptyFormats.erase("file");
-            }
-            else if (key == "line") {
-                ret.hasLine = true;
-                formats.push_back(defaultFormats.at("line"));
-                emptyFormats.erase("line");
-            }
-            else if (key == "func") {
-                formats.push_back(defaultFormats.at("func"));
-                emptyFormats.erase("func");
-            }
-            else if (key == "pid") {
-                ret.hasPid = true;
-                ret.pid = ::getpid();
-                formats.push_back(defaultFormats.at("pid"));
-                emptyFormats.erase("pid");
-            }
-            else if (key == "time") {
-                ret.hasTime = true;
-                ret.time = "%x %X";
-                formats.push_back(defaultFormats.at("time"));
-                emptyFormats.erase("time");
-            }
-            else if (key == "message") {
-                formats.push_back(defaultFormats.at("message"));
-                emptyFormats.erase("message");
-            }
-            else if (key == "microsec") {
-                formats.push_back(defaultFormats.at("microsec"));
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1000000;
-            }
-            else if (key == "millisec") {
-                formats.push_back(defaultFormats.at("millisec"));
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1000;
-            }
-            else if (key == "nanosec") {
-                formats.push_back(defaultFormats.at("nanosec"));
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1;
-            }
-            indexStart = format.find(LOGGER_OPEN_BRACE, indexStart + 1);
-            // find other key
-            continue;
+            key = format.substr(indexStart + 1, indexEnd - indexStart - 1);
         }
         else {
             // get name of key {[...]:...}
-            std::string key = format.substr(indexStart + 1, indexFormat - indexStart - 1);
+            key = format.substr(indexStart + 1, indexFormat - indexStart - 1);
             // get format of key {...:[...]}
-            std::string formatKey = format.substr(indexFormat + 1, indexEnd - indexFormat - 1);
+            specifier = format.substr(indexFormat + 1, indexEnd - indexFormat - 1);
             // replace no print character by real
-            s_formatDeserialize(formatKey);
-            if (key == "name") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("name"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("name");
-            }
-            else if (key == "level") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("level"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("level");
-            }
-            else if (key == "path") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("path"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("path");
-            }
-            else if (key == "file") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("file"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("file");
-            }
-            else if (key == "line") {
-                ret.hasLine = true;
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("line"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("line");
-            }
-            else if (key == "func") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("func"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("func");
-            }
-            else if (key == "pid") {
-                ret.hasPid = true;
-                ret.pid = ::getpid();
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("pid"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("pid");
-            }
-            else if (key == "time") {
-                ret.hasTime = true;
-                ret.time = formatKey;
-                formats.push_back("%" + keyToid.at("time") + "s");
-                emptyFormats.erase("time");
-            }
-            else if (key == "message") {
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("message"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("message");
+            s_formatDeserialize(specifier);
+            hasSpecifier = true;
+        }
+        // find other key
+        indexStart = format.find(LOGGER_OPEN_BRACE, indexStart + 1);
+
+        Format::Operation operation(Format::Operation::LITERAL);
+        if (key == "name" || key == "level" || key == "pid") {
+            // constant of format
+            operation.conversion = 's';
+        }
+        else if (key == "path") {
+            operation.type = Format::Operation::PATH;
+        }
+        else if (key == "file") {
+            operation.type = Format::Operation::FILENAME;
+        }
+        else if (key == "line") {
+            operation.type = Format::Operation::LINE;
+            operation.conversion = 'd';
+        }
+        else if (key == "func") {
+            operation.type = Format::Operation::FUNCTION;
+        }
+        else if (key == "time" || key == "utctime") {
+            operation.type = Format::Operation::TIME;
+            operation.isUtc = (key == "utctime");
+            _compileTime(operation, hasSpecifier ? specifier : "%x %X");
+            ret.operations.push_back(operation);
+            continue;
+        }
+        else if (key == "message") {
+            operation.type = Format::Operation::MESSAGE;
+        }
+        else if (key == "microsec" || key == "millisec" || key == "nanosec") {
+            operation.type = Format::Operation::DECIMAL;
+            operation.conversion = 'd';
+            operation.padding = '0';
+            if (key == "millisec") {
+                operation.nsecDivisor = 1000000;
+                operation.width = 3;
             }
             else if (key == "microsec") {
-                ret.hasMicroSec = true;
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("microsec"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1000000;
-            }
-            else if (key == "millisec") {
-                ret.hasMilliSec = true;
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("millisec"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1000;
-            }
-            else if (key == "nanosec") {
-                ret.hasNanoSec = true;
-                formatKey.insert(formatKey.find('%') + 1, keyToid.at("nanosec"));
-                formats.push_back(formatKey);
-                emptyFormats.erase("decimal");
-                ret.nsecDivisor = 1;
-            }
-            // parse other key
-            indexStart = format.find(LOGGER_OPEN_BRACE, indexStart + 1);
+                operation.nsecDivisor = 1000;
+                operation.width = 6;
+            }
+            else {
+                operation.nsecDivisor = 1;
+                operation.width = 9;
+            }
+        }
+        else {
+            // unknown key
             continue;
         }
+
+        std::string prefix;
+        std::string suffix;
+        if (hasSpecifier) {
+            operation.padding = ' ';
+            operation.width = 0;
+            _parseSpecifier(specifier, operation, prefix, suffix);
+        }
+        _appendLiteral(ret, prefix);
+        if (operation.type == Format::Operation::LITERAL) {
+            // render the constant now
+            std::string constant;
+            if (key == "pid") {
+                Format::Operation pidOperation(operation);
+                if (!hasSpecifier || pidOperation.conversion == 's') {
+                    pidOperation.conversion = 'd';
+                    pidOperation.printfFormat = "%ld";
+                }
+                _appendInteger(constant, pidOperation, ::getpid());
+            }
+            else {
+                _appendString(constant, operation, (key == "name") ? name.c_str() : _levelName(level));
+            }
+            _appendLiteral(ret, constant);
+        }
+        else {
+            ret.operations.push_back(operation);
+        }
+        _appendLiteral(ret, suffix);
     }
     // get last characters in format
-    if (lastIndexStart - format.size() > 0) {
-        std::string lastFormat = format.substr(lastIndexStart, format.size() - lastIndexStart);
-        s_formatDeserialize(lastFormat);
-        formats.push_back(lastFormat);
+    std::string lastFormat = format.substr(lastIndexStart);
+    s_formatDeserialize(lastFormat);
+    _appendLiteral(ret, lastFormat);
+    return ret;
+}
+
+void Logger::setName(const char* name_) {
+    pthread_mutex_lock(&_logMutex);
+    _name = name_;
+    // name is rendered in formats
+    static const eLevel levels[] = {EMERGENCY, ALERT, CRITICAL, ERROR, WARNING, NOTICE, INFO, DEBUG};
+    for (std::size_t i = 0; i < sizeof(levels) / sizeof(*levels); ++i) {
+        Format* format = _levelFormat(levels[i]);
+        *format = _formatContructor(format->origin.c_str(), _name, levels[i]);
+    }
+    for (std::vector<SinkEntry*>::iterator it = _sinks.begin(); it != _sinks.end(); ++it) {
+        for (std::size_t i = 0; i < (*it)->formats.size(); ++i) {
+            (*it)->formats[i] = _formatContructor((*it)->format.c_str(), _name, static_cast<eLevel>(i));
+        }
+        for (std::size_t i = 0; i < (*it)->fields.size(); ++i) {
+            SinkEntry::Field& field = (*it)->fields[i];
+            for (std::size_t j = 0; j < field.formats.size(); ++j) {
+                field.formats[j] = _formatContructor(field.format.c_str(), _name, static_cast<eLevel>(j));
+            }
+        }
+    }
+    // the logger thread copies the new formats
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
+}
+
+std::string Logger::getName() const {
+    pthread_mutex_lock(&const_cast<Logger*>(this)->_logMutex);
+    std::string name_(_name);
+    pthread_mutex_unlock(&const_cast<Logger*>(this)->_logMutex);
+    return name_;
+}
+
+void Logger::setTypeFormat(const eLevel& level, const char* format) {
+    pthread_mutex_lock(&_logMutex);
+    *_levelFormat(level) = _formatContructor(format, _name, level);
+    // the logger thread copies the new formats
+    ++_sinksGeneration;
+    pthread_mutex_unlock(&_logMutex);
+}
+
+void Logger::setAllFormat(const char* format) {
+    static const eLevel levels[] = {EMERGENCY, ALERT, CRITICAL, ERROR, WARNING, NOTICE, INFO, DEBUG};
+    for (std::size_t i = 0; i < sizeof(levels) / sizeof(*levels); ++i) {
+        setTypeFormat(levels[i], format);
+    }
+}
+
+void Logger::setOverflowPolicy(eOverflowPolicy policy, int64_t timeout) {
+    __atomic_store_n(&_overflowTimeout, timeout, __ATOMIC_RELAXED);
+    __atomic_store_n(&_overflowPolicy, static_cast<int>(policy), __ATOMIC_RELAXED);
+}
+
+unsigned long Logger::getDroppedCount() const {
+    unsigned long count = 0;
+    for (std::size_t i = 0; i < sizeof(_droppedCounts) / sizeof(*_droppedCounts); ++i) {
+        count += __atomic_load_n(&_droppedCounts[i], __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+void Logger::setFILE(FILE* file) {
+    _fileSink.setFILE(file);
+}
+
+char* Logger::_asyncBegin(eLevel level, const char* file, const char* filename, int line, const char* function,
+                          const char* format, RenderFunction render, const char* signature, std::size_t payloadSize,
+                          Ring** ring, Record** record) {
+    *ring = (_backend != NULL) ? _backend->_threadRing(_backendId) : static_cast<Ring*>(pthread_getspecific(_ringKey));
+    if (*ring == NULL) {
+        *ring = _ringRegister();
     }
 
-    {
-        std::map<std::string, std::string>::const_iterator cit;
-        for (cit = emptyFormats.begin(); cit != emptyFormats.end(); ++cit) {
-            ret.str.append(cit->second);
+    eClock clock = static_cast<eClock>(__atomic_load_n(&_clock, __ATOMIC_ACQUIRE));
+    uint64_t stamp = _clockNow(clock);
+
+    bool isOutOfLine = payloadSize > LOGGER_MESSAGE_MAX_SIZE;
+    *record = (*ring)->reserve(Record::alignSize(sizeof(Record) + (isOutOfLine ? 0 : payloadSize)),
+                               static_cast<eOverflowPolicy>(__atomic_load_n(&_overflowPolicy, __ATOMIC_RELAXED)),
+                               __atomic_load_n(&_overflowTimeout, __ATOMIC_RELAXED), _droppedCounts);
+    if (*record == NULL) {
+        // drop the new message
+        __atomic_add_fetch(&_droppedCounts[level], 1, __ATOMIC_RELAXED);
+        ++(*ring)->dropped;
+        return NULL;
+    }
+
+    // create a new message
+    (*record)->render = render;
+    (*record)->signature = signature;
+    (*record)->payloadSize = static_cast<unsigned int>(payloadSize);
+    (*record)->format = format;
+    (*record)->message.level = level;
+    (*record)->message.file = file;
+    (*record)->message.filename = filename;
+    (*record)->message.line = line;
+    (*record)->message.function = function;
+    (*record)->stamp = stamp;
+    (*record)->clock = clock;
+    if (isOutOfLine) {
+        // big payload allocated out of the ring
+        (*record)->outOfLine = new char[payloadSize];
+        return (*record)->outOfLine;
+    }
+    return reinterpret_cast<char*>(*record + 1);
+}
+
+void Logger::_asyncCommit(Ring* ring, Record* record) {
+    eLevel level = record->message.level;
+    // publish the message
+    ring->commit(record);
+
+    if (isDurable(level)) {
+        // wait the sync of sinks
+        _syncWait();
+    }
+    else {
+        // syscall only if the logger thread is parked
+        _wakeUp(false);
+    }
+
+#ifdef LOGGER_PERF_DEBUG
+    __atomic_add_fetch(&_messageCount, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static const int s_crashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+struct Logger::CrashState {
+    // a slot is set by compare and swap
+    Logger* loggers[LOGGER_CRASH_MAX_LOGGERS];
+    bool isInstalled;
+    bool isDone;
+    // kernel id of the thread in the handler
+    pid_t crashedTid;
+    struct sigaction oldActions[sizeof(s_crashSignals) / sizeof(*s_crashSignals)];
+};
+
+Logger::CrashState& Logger::_crashState() {
+    // zero initialized without guard, shared by the translation units of the single header
+    static CrashState state;
+    return state;
+}
+
+void Logger::setCrashFlush(int fd, int64_t timeout) {
+    __atomic_store_n(&_crashTimeout, timeout, __ATOMIC_RELAXED);
+    __atomic_store_n(&_crashFd, fd, __ATOMIC_RELEASE);
+    if (fd < 0) {
+        _crashUnregister();
+        return;
+    }
+    CrashState& state = _crashState();
+    bool isRegistered = false;
+    for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS && !isRegistered; ++i) {
+        isRegistered = __atomic_load_n(&state.loggers[i], __ATOMIC_ACQUIRE) == this;
+    }
+    for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS && !isRegistered; ++i) {
+        Logger* expected = NULL;
+        isRegistered = __atomic_compare_exchange_n(&state.loggers[i], &expected, this, false, __ATOMIC_ACQ_REL,
+                                                   __ATOMIC_ACQUIRE);
+    }
+    if (!isRegistered) {
+        __atomic_store_n(&_crashFd, -1, __ATOMIC_RELEASE);
+        throw Exception("setCrashFlush: ", "too many loggers");
+    }
+    if (!__atomic_exchange_n(&state.isInstalled, true, __ATOMIC_ACQ_REL)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &_crashHandler;
+        sigemptyset(&action.sa_mask);
+        // alternate stack of the thread for a stack overflow
+        action.sa_flags = SA_ONSTACK;
+        for (std::size_t i = 0; i < sizeof(s_crashSignals) / sizeof(*s_crashSignals); ++i) {
+            sigaction(s_crashSignals[i], &action, &state.oldActions[i]);
+        }
+    }
+}
+
+void Logger::_crashUnregister() {
+    CrashState& state = _crashState();
+    for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS; ++i) {
+        Logger* expected = this;
+        __atomic_compare_exchange_n(&state.loggers[i], &expected, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+}
+
+void Logger::_crashHandler(int sig) {
+    int savedErrno = errno;
+    CrashState& state = _crashState();
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    pid_t crashedTid = 0;
+    if (__atomic_compare_exchange_n(&state.crashedTid, &crashedTid, tid, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+        // request a flush of the logger threads
+        int64_t timeout = 0;
+        for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS; ++i) {
+            Logger* logger = __atomic_load_n(&state.loggers[i], __ATOMIC_ACQUIRE);
+            if (logger == NULL) {
+                continue;
+            }
+            logger->_crashTicket = 0;
+            pid_t threadTid = (logger->_worker != NULL) ? __atomic_load_n(&logger->_worker->tid, __ATOMIC_ACQUIRE)
+                                                        : __atomic_load_n(&logger->_threadLogTid, __ATOMIC_ACQUIRE);
+            if (threadTid == tid || !__atomic_load_n(&logger->_isStarted, __ATOMIC_ACQUIRE)) {
+                // the logger thread is crashed
+                continue;
+            }
+            logger->_crashTicket = __atomic_add_fetch(&logger->_flushSequence, 1, __ATOMIC_SEQ_CST);
+            logger->_wakeUp(true);
+            timeout = std::max(timeout, __atomic_load_n(&logger->_crashTimeout, __ATOMIC_RELAXED));
+        }
+        // wait the logger threads
+        int64_t deadline = s_clockGetTime(CLOCK_MONOTONIC) + timeout;
+        bool isFlushed = false;
+        while (!isFlushed) {
+            isFlushed = true;
+            for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS && isFlushed; ++i) {
+                Logger* logger = __atomic_load_n(&state.loggers[i], __ATOMIC_ACQUIRE);
+                isFlushed = logger == NULL || logger->_crashTicket == 0 || logger->isFlushed(logger->_crashTicket);
+            }
+            if (isFlushed || s_clockGetTime(CLOCK_MONOTONIC) >= deadline) {
+                break;
+            }
+            struct timespec sleepTime = {0, 1000000};
+            nanosleep(&sleepTime, NULL);
+        }
+        // write the messages not flushed
+        for (std::size_t i = 0; i < LOGGER_CRASH_MAX_LOGGERS; ++i) {
+            Logger* logger = __atomic_load_n(&state.loggers[i], __ATOMIC_ACQUIRE);
+            if (logger != NULL && (logger->_crashTicket == 0 || !logger->isFlushed(logger->_crashTicket))) {
+                logger->_crashWrite();
+            }
         }
+        __atomic_store_n(&state.isDone, true, __ATOMIC_RELEASE);
     }
-    {
-        std::list<std::string>::const_iterator cit;
-        for (cit = formats.begin(); cit != formats.end(); ++cit) {
-            ret.str.append(*cit);
+    else if (crashedTid != tid) {
+        // wait the handler of the first crashed thread
+        while (!__atomic_load_n(&state.isDone, __ATOMIC_ACQUIRE)) {
+            struct timespec sleepTime = {0, 1000000};
+            nanosleep(&sleepTime, NULL);
         }
     }
-    ret.str.append("\n");
-    return ret;
+    // raised with the previous action at the return of handler
+    for (std::size_t i = 0; i < sizeof(s_crashSignals) / sizeof(*s_crashSignals); ++i) {
+        if (s_crashSignals[i] == sig) {
+            sigaction(sig, &state.oldActions[i], NULL);
+        }
+    }
+    raise(sig);
+    errno = savedErrno;
 }
 
-void Logger::setTypeFormat(const eLevel& level, const char* format) {
-    switch (level) {
-        case EMERGENCY:
-            _emergencyFormat = _formatContructor(format);
+static void s_crashWrite(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t ret = write(fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += ret;
+        size -= static_cast<std::size_t>(ret);
+    }
+}
+
+/**
+ * @brief Append to the stack buffer of the fatal signal handler, the full buffer is written on fd.
+ */
+static void s_crashAppend(int fd, char* buffer, std::size_t& size, const char* str, std::size_t strSize) {
+    while (strSize > 0) {
+        if (size == LOGGER_CRASH_BUFFER_SIZE) {
+            s_crashWrite(fd, buffer, size);
+            size = 0;
+        }
+        std::size_t count = std::min(strSize, LOGGER_CRASH_BUFFER_SIZE - size);
+        memcpy(buffer + size, str, count);
+        size += count;
+        str += count;
+        strSize -= count;
+    }
+}
+
+static void s_crashAppendString(int fd, char* buffer, std::size_t& size, const char* str) {
+    std::size_t strSize = 0;
+    while (str[strSize] != '\0') {
+        ++strSize;
+    }
+    s_crashAppend(fd, buffer, size, str, strSize);
+}
+
+static void s_crashAppendUnsigned(int fd, char* buffer, std::size_t& size, uint64_t value, unsigned int base,
+                                  std::size_t minDigits = 1) {
+    static const char digits[] = "0123456789abcdef";
+    char str[24];
+    std::size_t index = sizeof(str);
+    while (value > 0 || sizeof(str) - index < minDigits) {
+        str[--index] = digits[value % base];
+        value /= base;
+    }
+    s_crashAppend(fd, buffer, size, str + index, sizeof(str) - index);
+}
+
+static void s_crashAppendSigned(int fd, char* buffer, std::size_t& size, int64_t value, unsigned int base) {
+    if (value < 0 && base == 10) {
+        s_crashAppend(fd, buffer, size, "-", 1);
+        s_crashAppendUnsigned(fd, buffer, size, 0 - static_cast<uint64_t>(value), base);
+    }
+    else {
+        s_crashAppendUnsigned(fd, buffer, size, static_cast<uint64_t>(value), base);
+    }
+}
+
+/**
+ * @brief Append a floating value with precision decimals (6 by default, 9 at most) rounded half up without snprintf.
+ */
+static void s_crashAppendFloating(int fd, char* buffer, std::size_t& size, long double value, int precision) {
+    if (value != value) {
+        s_crashAppend(fd, buffer, size, "nan", 3);
+        return;
+    }
+    if (value < 0) {
+        s_crashAppend(fd, buffer, size, "-", 1);
+        value = -value;
+    }
+    if (value >= 1e18) {
+        s_crashAppend(fd, buffer, size, ">1e18", 5);
+        return;
+    }
+    if (precision < 0) {
+        precision = 6;
+    }
+    else if (precision > 9) {
+        precision = 9;
+    }
+    uint64_t scale = 1;
+    for (int i = 0; i < precision; ++i) {
+        scale *= 10;
+    }
+    uint64_t integer = static_cast<uint64_t>(value);
+    uint64_t decimals = static_cast<uint64_t>((value - integer) * scale + 0.5);
+    if (decimals >= scale) {
+        // rounded to the next integer
+        ++integer;
+        decimals -= scale;
+    }
+    s_crashAppendUnsigned(fd, buffer, size, integer, 10);
+    if (precision > 0) {
+        s_crashAppend(fd, buffer, size, ".", 1);
+        s_crashAppendUnsigned(fd, buffer, size, decimals, 10, static_cast<std::size_t>(precision));
+    }
+}
+
+/**
+ * @brief Append a deferred argument of the fatal signal handler.
+ *
+ * @param conversion printf conversion of argument.
+ * @param precision precision of a floating or string conversion or -1.
+ * @return false if the arguments are invalid.
+ */
+static bool s_crashAppendArgument(int fd, char* buffer, std::size_t& size, char conversion, int precision,
+                                  const char*& signature, const char*& args, const char* argsEnd) {
+    unsigned int base = 10;
+    if (conversion == 'x' || conversion == 'X' || conversion == 'p') {
+        base = 16;
+    }
+    else if (conversion == 'o') {
+        base = 8;
+    }
+    bool isValid = true;
+    switch (*signature++) {
+        case 'b': {
+            signed char value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                if (conversion == 'c') {
+                    s_crashAppend(fd, buffer, size, reinterpret_cast<const char*>(&value), 1);
+                }
+                else {
+                    s_crashAppendSigned(fd, buffer, size, value, base);
+                }
+            }
             break;
-        case ALERT:
-            _alertFormat = _formatContructor(format);
+        }
+        case 'h': {
+            short value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendSigned(fd, buffer, size, value, base);
+            }
             break;
-        case CRITICAL:
-            _criticalFormat = _formatContructor(format);
+        }
+        case 'i': {
+            int value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendSigned(fd, buffer, size, value, base);
+            }
             break;
-        case ERROR:
-            _errorFormat = _formatContructor(format);
+        }
+        case 'l': {
+            int64_t value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendSigned(fd, buffer, size, value, base);
+            }
             break;
-        case WARNING:
-            _warningFormat = _formatContructor(format);
+        }
+        case 'B': {
+            unsigned char value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendUnsigned(fd, buffer, size, value, base);
+            }
             break;
-        case NOTICE:
-            _noticeFormat = _formatContructor(format);
+        }
+        case 'H': {
+            unsigned short value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendUnsigned(fd, buffer, size, value, base);
+            }
             break;
-        case INFO:
-            _infoFormat = _formatContructor(format);
+        }
+        case 'I': {
+            unsigned int value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendUnsigned(fd, buffer, size, value, base);
+            }
             break;
-        case DEBUG:
-            _debugFormat = _formatContructor(format);
+        }
+        case 'L': {
+            uint64_t value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendUnsigned(fd, buffer, size, value, base);
+            }
+            break;
+        }
+        case 't': {
+            bool value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendUnsigned(fd, buffer, size, value ? 1 : 0, base);
+            }
+            break;
+        }
+        case 'f': {
+            float value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendFloating(fd, buffer, size, value, precision);
+            }
+            break;
+        }
+        case 'd': {
+            double value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendFloating(fd, buffer, size, value, precision);
+            }
+            break;
+        }
+        case 'D': {
+            long double value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppendFloating(fd, buffer, size, value, precision);
+            }
+            break;
+        }
+        case 's': {
+            const char* value;
+            std::size_t valueSize;
+            if ((isValid = s_readFieldString(args, argsEnd, value, valueSize))) {
+                if (value == NULL) {
+                    s_crashAppend(fd, buffer, size, "(null)", 6);
+                }
+                else {
+                    if (precision >= 0 && valueSize > static_cast<std::size_t>(precision)) {
+                        valueSize = static_cast<std::size_t>(precision);
+                    }
+                    s_crashAppend(fd, buffer, size, value, valueSize);
+                }
+            }
+            break;
+        }
+        case 'p': {
+            const void* value;
+            if ((isValid = s_readArgument(args, argsEnd, value))) {
+                s_crashAppend(fd, buffer, size, "0x", 2);
+                s_crashAppendUnsigned(fd, buffer, size, reinterpret_cast<uintptr_t>(value), 16);
+            }
+            break;
+        }
+        default:
+            isValid = false;
             break;
     }
+    return isValid;
 }
 
-void Logger::setAllFormat(const char* format) {
-    _format = _formatContructor(format);
-    _emergencyFormat = _format;
-    _alertFormat = _format;
-    _criticalFormat = _format;
-    _errorFormat = _format;
-    _warningFormat = _format;
-    _noticeFormat = _format;
-    _infoFormat = _format;
-    _debugFormat = _format;
-    std::cerr << _format.str << std::endl;
+/**
+ * @brief Append a deferred message, the flags and width of conversions are ignored,
+ * the precision is used only by the floating and string conversions.
+ */
+static void s_crashAppendDeferred(int fd, char* buffer, std::size_t& size, const char* format, const char* signature,
+                                  const char* args, const char* argsEnd) {
+    while (*format != '\0') {
+        const char* literal = format;
+        while (*format != '\0' && *format != '%') {
+            ++format;
+        }
+        s_crashAppend(fd, buffer, size, literal, format - literal);
+        if (*format == '\0') {
+            break;
+        }
+        ++format;
+        if (*format == '%') {
+            s_crashAppend(fd, buffer, size, "%", 1);
+            ++format;
+            continue;
+        }
+        // flags, width, precision and length
+        bool isValid = true;
+        bool isPrecision = false;
+        int precision = -1;
+        for (; isValid && *format != '\0'; ++format) {
+            if (*format == '*') {
+                // width or precision argument
+                int value;
+                isValid = *signature++ != '\0' && s_readArgument(args, argsEnd, value);
+                if (isValid && isPrecision) {
+                    precision = (value < 0) ? -1 : value;
+                }
+            }
+            else if (*format == '.') {
+                isPrecision = true;
+                precision = 0;
+            }
+            else if (isPrecision && *format >= '0' && *format <= '9') {
+                precision = precision * 10 + (*format - '0');
+            }
+            else if ((*format < '0' || *format > '9') && *format != '-' && *format != '+' &&
+                     *format != ' ' && *format != '#' && *format != 'h' && *format != 'l' && *format != 'L' &&
+                     *format != 'q' && *format != 'j' && *format != 'z' && *format != 't') {
+                break;
+            }
+        }
+        if (!isValid || *format == '\0' || *signature == '\0' ||
+            !s_crashAppendArgument(fd, buffer, size, *format, precision, signature, args, argsEnd)) {
+            return;
+        }
+        ++format;
+    }
 }
 
-void Logger::setFILE(FILE* file) {
-    _pfile = file;
+void Logger::_crashAppendRecord(char* buffer, std::size_t& size, const Record* record) {
+    int fd = _crashFd;
+    if (record->dropped > 0) {
+        s_crashAppendString(fd, buffer, size, "WARNING: ");
+        s_crashAppendUnsigned(fd, buffer, size, record->dropped, 10);
+        s_crashAppendString(fd, buffer, size, " messages dropped\n");
+    }
+    if (!_name.empty()) {
+        s_crashAppend(fd, buffer, size, _name.data(), _name.size());
+        s_crashAppend(fd, buffer, size, ":", 1);
+    }
+    s_crashAppendString(fd, buffer, size, _levelName(record->message.level));
+    s_crashAppend(fd, buffer, size, ": ", 2);
+    s_crashAppendString(fd, buffer, size, record->message.file);
+    s_crashAppend(fd, buffer, size, ":", 1);
+    s_crashAppendSigned(fd, buffer, size, record->message.line, 10);
+    s_crashAppend(fd, buffer, size, " ", 1);
+    const char* payload =
+        (record->outOfLine != NULL) ? record->outOfLine : reinterpret_cast<const char*>(record + 1);
+    if (record->render == NULL) {
+        // message formated by asyncLog
+        if (record->payloadSize > 0) {
+            s_crashAppend(fd, buffer, size, payload, record->payloadSize - 1);
+        }
+    }
+    else if (record->render == &_renderStructured) {
+        // message followed by the key value fields
+        s_crashAppendString(fd, buffer, size, record->format);
+        const char* args = payload;
+        const char* argsEnd = payload + record->payloadSize;
+        const char* signature = record->signature;
+        for (; signature[0] == 's' && signature[1] != '\0';) {
+            const char* key;
+            std::size_t keySize;
+            if (!s_readFieldString(args, argsEnd, key, keySize) || key == NULL) {
+                break;
+            }
+            ++signature;
+            s_crashAppend(fd, buffer, size, " ", 1);
+            s_crashAppend(fd, buffer, size, key, keySize);
+            s_crashAppend(fd, buffer, size, "=", 1);
+            if (!s_crashAppendArgument(fd, buffer, size, 'd', -1, signature, args, argsEnd)) {
+                break;
+            }
+        }
+    }
+    else {
+        s_crashAppendDeferred(fd, buffer, size, record->format, record->signature, payload,
+                              payload + record->payloadSize);
+    }
+    s_crashAppend(fd, buffer, size, "\n", 1);
 }
 
-void Logger::asyncLog(eLevel level, const char* file, const char* filename, int line, const char* function,
-                    const char* format, ...) {
-    pthread_mutex_lock(&_logMutex);
-#ifdef LOGGER_ASYNC_WAIT_PRINT
-    if (_currentMessageId >= LOGGER_QUEUE_SIZE - LOGGER_MAX_LOG_THREAD_NB) {
-        // wait end of print
-        pthread_cond_wait(&_condLog, &_logMutex);
+void Logger::_crashWrite() {
+    int fd = __atomic_load_n(&_crashFd, __ATOMIC_ACQUIRE);
+    if (fd < 0) {
+        return;
     }
-#endif
-
-    // create a new message
-    _messages[_currentMessageId].level = level;
-    _messages[_currentMessageId].file = file;
-    _messages[_currentMessageId].filename = filename;
-    _messages[_currentMessageId].line = line;
-    _messages[_currentMessageId].function = function;
-
-    clock_gettime(CLOCK_REALTIME, &_messages[_currentMessageId].ts);
+    char buffer[LOGGER_CRASH_BUFFER_SIZE];
+    std::size_t size = 0;
+    // messages not taken by the logger thread, ordered by producer thread:
+    // - the records taken by the logger thread [tail, drainHead) are written by it or lost
+    //   if it does not finish its batch before the end of process.
+    // - the records published after drainHead are claimed like dropOldest when the logger thread has taken nothing,
+    //   else they are written from drainHead and may be written again if the logger thread takes them
+    //   before the end of process.
+    for (Ring* ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        uint64_t current = __atomic_load_n(&ring->cursor, __ATOMIC_ACQUIRE);
+        unsigned int head = __atomic_load_n(&ring->publishedHead, __ATOMIC_ACQUIRE);
+        unsigned int index = Ring::cursorDrainHead(current);
+        if (Ring::cursorTail(current) == index &&
+            !__atomic_compare_exchange_n(&ring->cursor, &current, Ring::makeCursor(head, head), false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // taken by the logger thread after the load of cursor
+            index = Ring::cursorDrainHead(current);
+            head = __atomic_load_n(&ring->publishedHead, __ATOMIC_ACQUIRE);
+        }
+        while (index != head) {
+            const Record* record = ring->at(index);
+            if (record->size == 0 || record->size > head - index) {
+                // corrupted ring
+                break;
+            }
+            if (!record->isPadding) {
+                _crashAppendRecord(buffer, size, record);
+            }
+            index += record->size;
+        }
+    }
+    s_crashWrite(fd, buffer, size);
+}
 
-    // copy formated message
+void Logger::asyncLog(eLevel level, const char* file, const char* filename, int line, const char* function,
+                    const char* format, ...) {
     va_list vargs;
     va_start(vargs, format);
-    ::vsnprintf(_messages[_currentMessageId].message, LOGGER_MESSAGE_MAX_SIZE, format, vargs);
+    _asyncVLog(level, file, filename, line, function, format, vargs);
     va_end(vargs);
-
-    // move index
-    ++_currentMessageId;
-#ifndef LOGGER_ASYNC_WAIT_PRINT
-    _currentMessageId = _currentMessageId % LOGGER_QUEUE_SIZE;
-#endif
-
-    sem_post(&_queueSemaphore);
-
-#ifdef LOGGER_PERF_DEBUG
-    ++_messageCount;
-#endif
-
-    pthread_mutex_unlock(&_logMutex);
 }
 
 void Logger::log(eLevel level, const char* file, const char* filename, int line, const char* function,
                const char* format, ...) {
-    Message message;
-
-    // create a new message
-    message.level = level;
-    message.file = file;
-    message.filename = filename;
-    message.line = line;
-    message.function = function;
-    clock_gettime(CLOCK_REALTIME, &message.ts);
-
-    // copy formated message
+    // written by the logger thread with the sinks
     va_list vargs;
     va_start(vargs, format);
-    ::vsnprintf(message.message, LOGGER_MESSAGE_MAX_SIZE, format, vargs);
+    _asyncVLog(level, file, filename, line, function, format, vargs);
     va_end(vargs);
+    flush();
+}
 
-#ifdef LOGGER_PERF_DEBUG
-    ++_messageCount;
-    ++_messagePrinted;
-#endif
-    printMessage(message);
+void Logger::_asyncVLog(eLevel level, const char* file, const char* filename, int line, const char* function,
+                        const char* format, va_list vargs) {
+    // format message on the stack
+    char buffer[LOGGER_MESSAGE_MAX_SIZE];
+    va_list copyVargs;
+    __builtin_va_copy(copyVargs, vargs);
+    int size = ::vsnprintf(buffer, sizeof(buffer), format, copyVargs);
+    va_end(copyVargs);
+    if (size < 0) {
+        size = 0;
+        buffer[0] = '\0';
+    }
+    std::size_t messageSize = static_cast<std::size_t>(size) + 1;
+
+    Ring* ring;
+    Record* record;
+    char* payload =
+        _asyncBegin(level, file, filename, line, function, format, NULL, NULL, messageSize, &ring, &record);
+    if (payload == NULL) {
+        return;
+    }
+    if (messageSize > sizeof(buffer)) {
+        // format again the truncated message
+        ::vsnprintf(payload, messageSize, format, vargs);
+    }
+    else {
+        ::memcpy(payload, buffer, messageSize);
+    }
+    record->message.message = payload;
+    _asyncCommit(ring, record);
 }
 
 } // namespace blet
 
 #undef LOGGER_CLOSE_BRACE
 #undef LOGGER_SEPARATOR
-#undef LOGGER_OPEN_BRACE
\ No newline at end of file
+#undef LOGGER_OPEN_BRACE
+#undef LOGGER_RECORD_ALIGN
+#undef LOGGER_CACHE_LINE_SIZE
\ No newline at end of file
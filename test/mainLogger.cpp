@@ -1,4 +1,13 @@
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iomanip>
+#include <locale.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "blet/logger.h"
 
@@ -8,8 +17,7 @@ GTEST_TEST(logger, littleflush) {
     LOGGER_MAIN().setAllFormat("{name} - {message} - {name}");
     for (int i = 0; i < 1000; ++i) {
         testing::internal::CaptureStdout();
-        LOGGER_DEBUG("main - test - main");
-        LOGGER_DEBUG("main - test - main");
+        LOGGER_DEBUG("test");
         LOGGER_FLUSH();
         std::string output = testing::internal::GetCapturedStdout();
         EXPECT_EQ(output, "main - test - main\n");
@@ -27,4 +35,1143 @@ GTEST_TEST(logger, bigflush) {
     LOGGER_FLUSH();
     std::string output = testing::internal::GetCapturedStdout();
     EXPECT_EQ(output, oss.str());
-}
\ No newline at end of file
+}
+static void* s_threadLogTest(void*) {
+    for (int i = 0; i < 1000; ++i) {
+        LOGGER_DEBUG("test");
+    }
+    return NULL;
+}
+
+GTEST_TEST(logger, multithread) {
+    LOGGER_MAIN().setAllFormat("{message}");
+    testing::internal::CaptureStdout();
+    std::ostringstream oss("");
+    pthread_t threads[8];
+    for (int i = 0; i < 8; ++i) {
+        pthread_create(&threads[i], NULL, &s_threadLogTest, NULL);
+    }
+    for (int i = 0; i < 8; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < 8 * 1000; ++i) {
+        oss << "test\n";
+    }
+    LOGGER_FLUSH();
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, oss.str());
+}
+
+static void* s_pipeReadTest(void* e) {
+    std::string* output = static_cast<std::string*>(e);
+    FILE* file = fdopen(*reinterpret_cast<const int*>(output->data()), "r");
+    output->clear();
+    char buffer[4096];
+    std::size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        output->append(buffer, size);
+    }
+    fclose(file);
+    return NULL;
+}
+
+GTEST_TEST(logger, pipe) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    // the writer has to wait the reader when the pipe is full
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    std::string output(reinterpret_cast<const char*>(&fds[0]), sizeof(fds[0]));
+    pthread_t reader;
+    pthread_create(&reader, NULL, &s_pipeReadTest, &output);
+    FILE* file = fdopen(fds[1], "w");
+    std::ostringstream oss("");
+    {
+        blet::Logger logger;
+        logger.setFILE(file);
+        logger.setAllFormat("{message}");
+        for (int i = 0; i < 100000; ++i) {
+            LOGGER_TO_INFO(logger, "%d", i);
+            oss << i << '\n';
+        }
+        LOGGER_TO_FLUSH(logger);
+    }
+    fclose(file);
+    pthread_join(reader, NULL);
+    EXPECT_EQ(output, oss.str());
+}
+
+GTEST_TEST(logger, overflowPolicy) {
+    const blet::Logger::eOverflowPolicy policies[] = {blet::Logger::DROP_NEWEST_OVERFLOW,
+                                                      blet::Logger::OVERWRITE_OLDEST_OVERFLOW,
+                                                      blet::Logger::BLOCK_TIMEOUT_OVERFLOW};
+    const std::string text(100, 'x');
+    for (size_t i = 0; i < sizeof(policies) / sizeof(*policies); ++i) {
+        int fds[2];
+        ASSERT_EQ(pipe(fds), 0);
+        std::string output(reinterpret_cast<const char*>(&fds[0]), sizeof(fds[0]));
+        FILE* file = fdopen(fds[1], "w");
+        unsigned long dropped;
+        unsigned long droppedInfo;
+        {
+            blet::Logger logger;
+            logger.setFILE(file);
+            logger.setAllFormat("{message}");
+            logger.setOverflowPolicy(policies[i], 10000);
+            EXPECT_EQ(logger.getOverflowPolicy(), policies[i]);
+            // the logger thread is blocked by the full pipe
+            for (int j = 0; j < 5000; ++j) {
+                LOGGER_TO_INFO(logger, "%d %s", j, text.c_str());
+            }
+            pthread_t reader;
+            pthread_create(&reader, NULL, &s_pipeReadTest, &output);
+            LOGGER_TO_FLUSH(logger);
+            // the queue is recovered
+            LOGGER_TO_WARN(logger, "end");
+            LOGGER_TO_FLUSH(logger);
+            dropped = logger.getDroppedCount();
+            droppedInfo = logger.getDroppedCount(blet::Logger::INFO);
+            fclose(file);
+            pthread_join(reader, NULL);
+        }
+        EXPECT_GT(dropped, 0ul) << i;
+        EXPECT_EQ(droppedInfo, dropped) << i;
+        std::istringstream iss(output);
+        std::string line;
+        unsigned long printed = 0;
+        unsigned long reported = 0;
+        std::string last;
+        while (std::getline(iss, line)) {
+            if (line.find(" messages dropped") != std::string::npos) {
+                reported += strtoul(line.c_str(), NULL, 10);
+            }
+            else {
+                if (line != "end") {
+                    last = line;
+                }
+                ++printed;
+            }
+        }
+        EXPECT_EQ(printed + dropped, 5001ul) << i;
+        EXPECT_EQ(reported, dropped) << i;
+        if (policies[i] == blet::Logger::OVERWRITE_OLDEST_OVERFLOW) {
+            EXPECT_EQ(last, "4999 " + text);
+        }
+        else {
+            EXPECT_EQ(output.substr(0, 2), "0 ");
+        }
+    }
+}
+
+GTEST_TEST(logger, flushTimeout) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::string output(reinterpret_cast<const char*>(&fds[0]), sizeof(fds[0]));
+    FILE* file = fdopen(fds[1], "w");
+    const std::string text(1000, 'x');
+    std::ostringstream oss("");
+    {
+        blet::Logger logger;
+        logger.setFILE(file);
+        logger.setAllFormat("{message}");
+        EXPECT_TRUE(logger.flush(1000000000ll));
+        // the logger thread is blocked by the full pipe
+        for (int i = 0; i < 100; ++i) {
+            LOGGER_TO_INFO(logger, "%s", text.c_str());
+            oss << text << '\n';
+        }
+        EXPECT_FALSE(logger.flush(1000000));
+        pthread_t reader;
+        pthread_create(&reader, NULL, &s_pipeReadTest, &output);
+        EXPECT_TRUE(logger.flush(10000000000ll));
+        fclose(file);
+        pthread_join(reader, NULL);
+    }
+    EXPECT_EQ(output, oss.str());
+}
+
+static void s_flushCallbackTest(unsigned long ticket, void* userData) {
+    __atomic_store_n(static_cast<unsigned long*>(userData), ticket, __ATOMIC_RELEASE);
+}
+
+GTEST_TEST(logger, flushAsync) {
+    blet::Logger logger;
+    logger.setAllFormat("{message}");
+    unsigned long callbackTicket = 0;
+    logger.setFlushCallback(&s_flushCallbackTest, &callbackTicket);
+    testing::internal::CaptureStdout();
+    LOGGER_TO_INFO(logger, "test");
+    unsigned long ticket = logger.flushAsync();
+    struct pollfd pfd;
+    pfd.fd = logger.getFlushFd();
+    pfd.events = POLLIN;
+    while (!logger.isFlushed(ticket)) {
+        ASSERT_EQ(poll(&pfd, 1, 10000), 1);
+        uint64_t events;
+        ASSERT_EQ(read(pfd.fd, &events, sizeof(events)), static_cast<ssize_t>(sizeof(events)));
+    }
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "test\n");
+    logger.flush();
+    EXPECT_GE(__atomic_load_n(&callbackTicket, __ATOMIC_ACQUIRE), ticket);
+}
+
+GTEST_TEST(logger, batchDelay) {
+    blet::Logger logger;
+    logger.setAllFormat("{message}");
+    logger.setBatchDelay(1000);
+    std::ostringstream oss("");
+    testing::internal::CaptureStdout();
+    for (int i = 0; i < 1000; ++i) {
+        LOGGER_TO_INFO(logger, "%d", i);
+        oss << i << '\n';
+        if (i % 100 == 0) {
+            // let the logger thread be parked
+            usleep(2000);
+        }
+    }
+    LOGGER_TO_FLUSH(logger);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, oss.str());
+}
+
+class StringSinkTest: public blet::Logger::Sink {
+  public:
+    StringSinkTest() :
+        syncCount(0) {}
+
+    void write(const char* data, std::size_t size) {
+        str.append(data, size);
+    }
+
+    void sync() {
+        ++syncCount;
+    }
+
+    std::string str;
+    int syncCount;
+};
+
+GTEST_TEST(logger, sink) {
+    blet::Logger logger;
+    logger.setAllFormat("{message}");
+    StringSinkTest warningSink;
+    StringSinkTest debugSink;
+    StringSinkTest levelSink;
+    logger.addSink(&warningSink, blet::Logger::WARNING, "{level} {message}");
+    logger.addSink(&debugSink, blet::Logger::DEBUG, "{level} {message}");
+    logger.addSink(&levelSink, blet::Logger::INFO);
+    testing::internal::CaptureStdout();
+    LOGGER_TO_ERR(logger, "error");
+    LOGGER_TO_INFO(logger, "info");
+    LOGGER_TO_DEBUG(logger, "debug");
+    LOGGER_TO_FLUSH(logger);
+    logger.removeSink(&debugSink);
+    LOGGER_TO_ERR(logger, "end");
+    LOGGER_TO_FLUSH(logger);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "error\ninfo\ndebug\nend\n");
+    EXPECT_EQ(warningSink.str, "ERROR error\nERROR end\n");
+    EXPECT_EQ(debugSink.str, "ERROR error\nINFO info\nDEBUG debug\n");
+    EXPECT_EQ(levelSink.str, "error\ninfo\nend\n");
+}
+
+static std::string s_readFileTest(const std::string& path) {
+    std::string str;
+    FILE* file = fopen(path.c_str(), "r");
+    if (file != NULL) {
+        char buffer[4096];
+        std::size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            str.append(buffer, size);
+        }
+        fclose(file);
+    }
+    return str;
+}
+
+GTEST_TEST(logger, rotatingFileSink) {
+    char dir[] = "/tmp/loggerRotatingXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    std::string path = std::string(dir) + "/test.log";
+    std::ostringstream oss("");
+    {
+        blet::Logger logger;
+        logger.setFILE(NULL);
+        logger.setAllFormat("{message}");
+        blet::Logger::RotatingFileSink sink(path.c_str(), 1000, blet::Logger::RotatingFileSink::DAILY_ROTATION, 2);
+        EXPECT_EQ(access((path + ".next").c_str(), F_OK), 0);
+        logger.addSink(&sink);
+        for (int i = 0; i < 1000; ++i) {
+            LOGGER_TO_INFO(logger, "%04d", i);
+            oss << std::setw(4) << std::setfill('0') << i << '\n';
+        }
+        LOGGER_TO_FLUSH(logger);
+        logger.removeSink(&sink);
+    }
+    EXPECT_NE(access((path + ".next").c_str(), F_OK), 0);
+    EXPECT_NE(access((path + ".3").c_str(), F_OK), 0);
+    std::string rotated2 = s_readFileTest(path + ".2");
+    std::string rotated1 = s_readFileTest(path + ".1");
+    std::string current = s_readFileTest(path);
+    EXPECT_EQ(rotated2.size(), 1000u);
+    EXPECT_EQ(rotated1.size(), 1000u);
+    EXPECT_EQ(current.size(), 1000u);
+    EXPECT_EQ(rotated2 + rotated1 + current, oss.str().substr(oss.str().size() - 3000));
+    unlink((path + ".2").c_str());
+    unlink((path + ".1").c_str());
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+static void s_checkIndexTest(const std::string& path, const std::string& content) {
+    std::vector<blet::Logger::FileIndex::Block> blocks;
+    blet::Logger::FileIndex::read(blet::Logger::FileIndex::getPath(path).c_str(), blocks);
+    ASSERT_FALSE(blocks.empty());
+    uint64_t offset = 0;
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+        // contiguous blocks of complete messages
+        EXPECT_EQ(blocks[i].offset, offset);
+        EXPECT_LE(blocks[i].minStamp, blocks[i].maxStamp);
+        EXPECT_EQ(content[blocks[i].offset + blocks[i].size - 1], '\n');
+        offset += blocks[i].size;
+    }
+    EXPECT_EQ(offset, content.size());
+}
+
+GTEST_TEST(logger, fileIndex) {
+    char dir[] = "/tmp/loggerIndexXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    std::string path = std::string(dir) + "/test.log";
+    {
+        blet::Logger logger;
+        logger.setFILE(NULL);
+        logger.setAllFormat("{message}");
+        blet::Logger::RotatingFileSink sink(path.c_str(), 1000, blet::Logger::RotatingFileSink::NO_ROTATION, 1, 100);
+        logger.addSink(&sink);
+        for (int i = 0; i < 400; ++i) {
+            if (i == 350) {
+                LOGGER_TO_ERR(logger, "%04d", i);
+            }
+            else {
+                LOGGER_TO_INFO(logger, "%04d", i);
+            }
+        }
+        LOGGER_TO_FLUSH(logger);
+        logger.removeSink(&sink);
+    }
+    std::string rotated1 = s_readFileTest(path + ".1");
+    std::string current = s_readFileTest(path);
+    EXPECT_EQ(rotated1.size(), 1000u);
+    EXPECT_EQ(current.size(), 1000u);
+    s_checkIndexTest(path + ".1", rotated1);
+    s_checkIndexTest(path, current);
+
+    // jump to the error
+    std::vector<blet::Logger::FileIndex::Block> blocks;
+    std::vector<blet::Logger::FileIndex::Block> found;
+    blet::Logger::FileIndex::read(blet::Logger::FileIndex::getPath(path).c_str(), blocks);
+    blet::Logger::FileIndex::find(blocks, INT64_MIN, INT64_MAX, blet::Logger::ERROR, found);
+    ASSERT_EQ(found.size(), 1u);
+    EXPECT_NE(current.substr(found[0].offset, found[0].size).find("0350\n"), std::string::npos);
+    // all blocks are merged
+    found.clear();
+    blet::Logger::FileIndex::find(blocks, INT64_MIN, INT64_MAX, blet::Logger::DEBUG, found);
+    ASSERT_EQ(found.size(), 1u);
+    EXPECT_EQ(found[0].offset, 0u);
+    EXPECT_EQ(found[0].size, current.size());
+    // time range
+    found.clear();
+    blet::Logger::FileIndex::find(blocks, blocks.back().maxStamp + 1, INT64_MAX, blet::Logger::DEBUG, found);
+    EXPECT_TRUE(found.empty());
+    found.clear();
+    blet::Logger::FileIndex::find(blocks, blocks.back().maxStamp, blocks.back().maxStamp, blet::Logger::DEBUG, found);
+    ASSERT_FALSE(found.empty());
+    EXPECT_EQ(found.back().offset + found.back().size, current.size());
+
+    unlink((path + ".1").c_str());
+    unlink(blet::Logger::FileIndex::getPath(path + ".1").c_str());
+    unlink(path.c_str());
+    unlink(blet::Logger::FileIndex::getPath(path).c_str());
+    rmdir(dir);
+}
+
+GTEST_TEST(logger, mmapFileSink) {
+    char dir[] = "/tmp/loggerMmapXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    std::string path = std::string(dir) + "/test.log";
+    std::ostringstream oss("");
+    {
+        blet::Logger logger;
+        logger.setFILE(NULL);
+        logger.setAllFormat("{message}");
+        blet::Logger::MmapFileSink sink(path.c_str(), 4096, 4096, 256);
+        EXPECT_EQ(sink.getPath(), path + ".0");
+        logger.addSink(&sink);
+        for (int i = 0; i < 3000; ++i) {
+            LOGGER_TO_INFO(logger, "%04d", i);
+            oss << std::setw(4) << std::setfill('0') << i << '\n';
+        }
+        LOGGER_TO_FLUSH(logger);
+        logger.removeSink(&sink);
+    }
+    std::string output;
+    for (int i = 0; access((path + "." + static_cast<char>('0' + i)).c_str(), F_OK) == 0; ++i) {
+        std::string segment = s_readFileTest(path + "." + static_cast<char>('0' + i));
+        // truncated to the last message
+        EXPECT_LE(segment.size(), 4096u);
+        EXPECT_EQ(segment[segment.size() - 1], '\n');
+        s_checkIndexTest(path + "." + static_cast<char>('0' + i), segment);
+        output += segment;
+        unlink((path + "." + static_cast<char>('0' + i)).c_str());
+        unlink(blet::Logger::FileIndex::getPath(path + "." + static_cast<char>('0' + i)).c_str());
+    }
+    EXPECT_EQ(output, oss.str());
+    rmdir(dir);
+}
+
+GTEST_TEST(logger, uringFileSink) {
+    char dir[] = "/tmp/loggerUringXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    // io_uring and write(2) fallback
+    const unsigned int queueDepths[] = {4, 0};
+    for (size_t i = 0; i < sizeof(queueDepths) / sizeof(*queueDepths); ++i) {
+        std::string path = std::string(dir) + "/test.log";
+        std::ostringstream oss("");
+        {
+            blet::Logger logger;
+            logger.setFILE(NULL);
+            logger.setAllFormat("{message}");
+            blet::Logger::UringFileSink sink(path.c_str(), queueDepths[i], 4096);
+            if (queueDepths[i] == 0) {
+                EXPECT_FALSE(sink.isUring());
+            }
+            logger.addSink(&sink);
+            for (int j = 0; j < 10000; ++j) {
+                LOGGER_TO_INFO(logger, "%05d", j);
+                oss << std::setw(5) << std::setfill('0') << j << '\n';
+                if (j == 5000) {
+                    LOGGER_TO_FLUSH(logger);
+                    EXPECT_EQ(s_readFileTest(path), oss.str());
+                }
+            }
+            LOGGER_TO_FLUSH(logger);
+            logger.removeSink(&sink);
+        }
+        EXPECT_EQ(s_readFileTest(path), oss.str()) << i;
+        unlink(path.c_str());
+    }
+    rmdir(dir);
+}
+
+GTEST_TEST(logger, durable) {
+    blet::Logger logger;
+    logger.setFILE(NULL);
+    logger.setAllFormat("{message}");
+    StringSinkTest sink;
+    logger.addSink(&sink);
+    logger.setDurable(blet::Logger::ERROR, true);
+    EXPECT_TRUE(logger.isDurable(blet::Logger::ERROR));
+    EXPECT_FALSE(logger.isDurable(blet::Logger::INFO));
+    std::ostringstream oss("");
+    for (int i = 0; i < 100; ++i) {
+        LOGGER_TO_INFO(logger, "%d", i);
+        oss << i << '\n';
+    }
+    LOGGER_TO_ERR(logger, "durable");
+    oss << "durable\n";
+    // written and synced without flush
+    EXPECT_EQ(sink.str, oss.str());
+    EXPECT_EQ(sink.syncCount, 1);
+    logger.removeSink(&sink);
+}
+
+GTEST_TEST(logger, binarySink) {
+    blet::Logger logger;
+    logger.setName("binary");
+    logger.setAllFormat("{name} {level} {line} {message}");
+    StringSinkTest textSink;
+    StringSinkTest binarySink;
+    logger.addSink(&textSink);
+    logger.addBinarySink(&binarySink);
+    logger.setFILE(NULL);
+    const char* nullStr = NULL;
+    for (int i = 0; i < 3; ++i) {
+        LOGGER_TO_INFO(logger, "int:%d uint:%u long:%ld char:%c", -i, 42u, 1234567890123l, 'a' + i);
+        LOGGER_TO_ERR(logger, "double:%.3f float:%5.1f str:%s null:%s ptr:%p%%", 3.14159 * i, 2.5f, "text",
+                      nullStr, static_cast<void*>(&logger));
+        LOGGER_TO_DEBUG(logger, "width:%*d|%-*.*s|", 6, i, 8, 2, "abcdef");
+        LOGGER_TO_INFO(logger, "%2$s-%1$d|%3$*4$d|", 7 + i, "pos", i, 4);
+    }
+    std::string message("not deferred");
+    LOGGER_TO_WARN(logger, message.c_str());
+    LOGGER_TO_INFO_KV(logger, "fields", "key", "a value", "ok", false);
+    // the name is read by the logger thread
+    LOGGER_TO_FLUSH(logger);
+    logger.setName("renamed");
+    LOGGER_TO_NOTICE(logger, "after rename %hhd %hu", static_cast<signed char>(-1), static_cast<unsigned short>(7));
+    LOGGER_TO_FLUSH(logger);
+    logger.removeSink(&textSink);
+    logger.removeSink(&binarySink);
+    EXPECT_EQ(binarySink.str.compare(0, 8, LOGGER_BINARY_MAGIC), 0);
+
+    FILE* file = fmemopen(&binarySink.str[0], binarySink.str.size(), "rb");
+    ASSERT_TRUE(file != NULL);
+    blet::Logger reader;
+    reader.setAllFormat("{name} {level} {line} {message}");
+    blet::Logger::BinaryReader binaryReader(file);
+    blet::Logger::Message readMessage;
+    int count = 0;
+    testing::internal::CaptureStdout();
+    while (binaryReader.next(readMessage)) {
+        if (reader.getName() != binaryReader.getName()) {
+            reader.setName(binaryReader.getName().c_str());
+        }
+        reader.printMessage(readMessage);
+        ++count;
+    }
+    fflush(stdout);
+    std::string output = testing::internal::GetCapturedStdout();
+    fclose(file);
+    EXPECT_EQ(count, 15);
+    EXPECT_NE(textSink.str.find("pos-7|   0|"), std::string::npos);
+    EXPECT_EQ(binaryReader.getOffset(), static_cast<long>(binarySink.str.size()));
+    EXPECT_EQ(output, textSink.str);
+
+    // invalid stream
+    char invalid[] = "NOTALOG!";
+    file = fmemopen(invalid, sizeof(invalid) - 1, "rb");
+    ASSERT_TRUE(file != NULL);
+    blet::Logger::BinaryReader invalidReader(file);
+    EXPECT_THROW(invalidReader.next(readMessage), blet::Logger::Exception);
+    fclose(file);
+
+    // site of "%n" with an int argument
+    std::string site(LOGGER_BINARY_MAGIC);
+    site += std::string("S\0\6\1\0\0\0\0\2%n\1i", 13);
+    std::string unsafe = site + std::string("M\0\0\4\0\0\0\0", 8);
+    file = fmemopen(&unsafe[0], unsafe.size(), "rb");
+    ASSERT_TRUE(file != NULL);
+    blet::Logger::BinaryReader unsafeReader(file);
+    EXPECT_THROW(unsafeReader.next(readMessage), blet::Logger::Exception);
+    fclose(file);
+
+    // payload size bigger than the stream
+    std::string truncated = site + std::string("M\0\0\xff\xff\xff\xff\x0f", 8);
+    file = fmemopen(&truncated[0], truncated.size(), "rb");
+    ASSERT_TRUE(file != NULL);
+    blet::Logger::BinaryReader truncatedReader(file);
+    EXPECT_THROW(truncatedReader.next(readMessage), blet::Logger::Exception);
+    fclose(file);
+}
+
+/**
+ * @brief Decode alone a file of a split binary stream.
+ */
+static std::string s_readBinaryFileTest(const std::string& path, time_t since) {
+    std::string content = s_readFileTest(path);
+    EXPECT_EQ(content.compare(0, 8, LOGGER_BINARY_MAGIC), 0);
+    FILE* file = fmemopen(&content[0], content.size(), "rb");
+    EXPECT_TRUE(file != NULL);
+    std::string output;
+    if (file == NULL) {
+        return output;
+    }
+    blet::Logger::BinaryReader binaryReader(file);
+    blet::Logger::Message readMessage;
+    while (binaryReader.next(readMessage)) {
+        // the timestamps restart in each file
+        EXPECT_GE(readMessage.ts.tv_sec, since);
+        EXPECT_LE(readMessage.ts.tv_sec, time(NULL));
+        EXPECT_EQ(binaryReader.getName(), "split");
+        output += readMessage.message;
+        output += '\n';
+    }
+    fclose(file);
+    return output;
+}
+
+GTEST_TEST(logger, binarySplit) {
+    char dir[] = "/tmp/loggerBinarySplitXXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    std::string path = std::string(dir) + "/test.bin";
+    std::string mmapPath = std::string(dir) + "/test.mmap";
+    std::ostringstream oss("");
+    time_t since = time(NULL);
+    {
+        blet::Logger logger;
+        logger.setFILE(NULL);
+        logger.setName("split");
+        blet::Logger::RotatingFileSink sink(path.c_str(), 512, blet::Logger::RotatingFileSink::NO_ROTATION, 64);
+        blet::Logger::MmapFileSink mmapSink(mmapPath.c_str(), 4096, 0);
+        logger.addBinarySink(&sink);
+        logger.addBinarySink(&mmapSink);
+        for (int i = 0; i < 400; ++i) {
+            LOGGER_TO_INFO(logger, "binary %04d\n", i);
+            LOGGER_TO_DEBUG(logger, "value %.1f", i / 2.0);
+            oss << "binary " << std::setw(4) << std::setfill('0') << i << "\n\n";
+            oss << "value " << i / 2 << '.' << (i % 2 == 0 ? '0' : '5') << '\n';
+        }
+        LOGGER_TO_FLUSH(logger);
+        logger.removeSink(&sink);
+        logger.removeSink(&mmapSink);
+    }
+    // each rotated file is decoded alone
+    std::string output;
+    unsigned int rotatedCount = 0;
+    while (access((path + "." + std::to_string(rotatedCount + 1)).c_str(), F_OK) == 0) {
+        ++rotatedCount;
+    }
+    EXPECT_GT(rotatedCount, 1u);
+    for (unsigned int i = rotatedCount; i > 0; --i) {
+        std::string rotatedPath = path + "." + std::to_string(i);
+        EXPECT_LE(s_readFileTest(rotatedPath).size(), 512u);
+        output += s_readBinaryFileTest(rotatedPath, since);
+        unlink(rotatedPath.c_str());
+    }
+    output += s_readBinaryFileTest(path, since);
+    unlink(path.c_str());
+    EXPECT_EQ(output, oss.str());
+
+    // each segment is decoded alone
+    output.clear();
+    unsigned int segmentCount = 0;
+    for (; access((mmapPath + "." + std::to_string(segmentCount)).c_str(), F_OK) == 0; ++segmentCount) {
+        std::string segmentPath = mmapPath + "." + std::to_string(segmentCount);
+        EXPECT_LE(s_readFileTest(segmentPath).size(), 4096u);
+        output += s_readBinaryFileTest(segmentPath, since);
+        unlink(segmentPath.c_str());
+    }
+    EXPECT_GT(segmentCount, 1u);
+    EXPECT_EQ(output, oss.str());
+    rmdir(dir);
+}
+
+GTEST_TEST(logger, structuredSink) {
+    blet::Logger logger;
+    logger.setName("kv");
+    logger.setAllFormat("{level} {message}");
+    StringSinkTest textSink;
+    StringSinkTest jsonSink;
+    StringSinkTest logfmtSink;
+    StringSinkTest defaultSink;
+    logger.addSink(&textSink);
+    logger.addStructuredSink(&jsonSink, blet::Logger::DEBUG, blet::Logger::JSON_STRUCTURED, "{name}{level}{line}");
+    logger.addStructuredSink(&logfmtSink, blet::Logger::INFO, blet::Logger::LOGFMT_STRUCTURED, "{level:%.1s}");
+    logger.addStructuredSink(&defaultSink);
+    logger.setFILE(NULL);
+    const char* nullStr = NULL;
+    int line = __LINE__ + 1;
+    LOGGER_TO_INFO_KV(logger, "req done", "status", 200, "ms", 1.5, "path", "/a b", "ok", true, "none", nullStr);
+    LOGGER_TO_DEBUG_KV(logger, "escape", "quote", "say \"hi\"\n", "max", 18446744073709551615ull, "neg", -42ll,
+                       "ratio", 0.1f, "tab", "\t\x01");
+    LOGGER_TO_WARN(logger, "plain %d", 1);
+    LOGGER_TO_ERR_KV(logger, "no field");
+    LOGGER_TO_FLUSH(logger);
+    logger.removeSink(&textSink);
+    logger.removeSink(&jsonSink);
+    logger.removeSink(&logfmtSink);
+    logger.removeSink(&defaultSink);
+
+    EXPECT_EQ(textSink.str,
+              "INFO req done status=200 ms=1.5 path=\"/a b\" ok=true none=\n"
+              "DEBUG escape quote=\"say \\\"hi\\\"\\n\" max=18446744073709551615 neg=-42 ratio=0.1 "
+              "tab=\"\\t\\u0001\"\n"
+              "WARN plain 1\n"
+              "ERROR no field\n");
+    std::ostringstream json("");
+    json << "{\"name\":\"kv\",\"level\":\"INFO\",\"line\":" << line
+         << ",\"message\":\"req done\",\"status\":200,\"ms\":1.5,\"path\":\"/a b\",\"ok\":true,\"none\":null}\n"
+         << "{\"name\":\"kv\",\"level\":\"DEBUG\",\"line\":" << line + 1
+         << ",\"message\":\"escape\",\"quote\":\"say \\\"hi\\\"\\n\",\"max\":18446744073709551615,\"neg\":-42,"
+            "\"ratio\":0.1,\"tab\":\"\\t\\u0001\"}\n"
+         << "{\"name\":\"kv\",\"level\":\"WARN\",\"line\":" << line + 3 << ",\"message\":\"plain 1\"}\n"
+         << "{\"name\":\"kv\",\"level\":\"ERROR\",\"line\":" << line + 4 << ",\"message\":\"no field\"}\n";
+    EXPECT_EQ(jsonSink.str, json.str());
+    EXPECT_EQ(logfmtSink.str,
+              "level=I message=\"req done\" status=200 ms=1.5 path=\"/a b\" ok=true none=\n"
+              "level=W message=\"plain 1\"\n"
+              "level=E message=\"no field\"\n");
+    EXPECT_EQ(defaultSink.str.compare(0, 9, "{\"time\":\""), 0);
+    EXPECT_NE(defaultSink.str.find("\"name\":\"kv\",\"level\":\"INFO\",\"path\":\"" __FILE__ "\",\"line\":"),
+              std::string::npos);
+    EXPECT_NE(defaultSink.str.find(",\"func\":\"TestBody\",\"message\":\"req done\",\"status\":200"),
+              std::string::npos);
+}
+
+GTEST_TEST(logger, structuredEscape) {
+    blet::Logger logger;
+    logger.setFILE(NULL);
+    StringSinkTest jsonSink;
+    StringSinkTest logfmtSink;
+    logger.addStructuredSink(&jsonSink, blet::Logger::DEBUG, blet::Logger::JSON_STRUCTURED, "{level:%.1s}");
+    logger.addStructuredSink(&logfmtSink, blet::Logger::DEBUG, blet::Logger::LOGFMT_STRUCTURED, "{level:%.1s}");
+    LOGGER_TO_INFO_KV(logger, "bad \xff utf8 \xc3\xa9", "key space", 1, "k=v", "\xfe", "", 2, "\xc3\xa9t\xe9", 0.25);
+    LOGGER_TO_FLUSH(logger);
+    EXPECT_EQ(jsonSink.str, "{\"level\":\"I\",\"message\":\"bad \\ufffd utf8 \xc3\xa9\",\"key space\":1,"
+                            "\"k=v\":\"\\ufffd\",\"\":2,\"\xc3\xa9t\\ufffd\":0.25}\n");
+    EXPECT_EQ(logfmtSink.str, "level=I message=\"bad \\ufffd utf8 \xc3\xa9\" key_space=1 k_v=\"\\ufffd\" _=2 "
+                              "\xc3\xa9t_=0.25\n");
+
+    // the decimal point of LC_NUMERIC is not used
+    const char* locales[] = {"de_DE.UTF-8", "fr_FR.UTF-8", "de_DE.utf8", "fr_FR.utf8"};
+    for (std::size_t i = 0; i < sizeof(locales) / sizeof(*locales); ++i) {
+        if (setlocale(LC_NUMERIC, locales[i]) == NULL) {
+            continue;
+        }
+        jsonSink.str.clear();
+        LOGGER_TO_INFO_KV(logger, "locale", "ms", 1.5, "ratio", 0.1f);
+        LOGGER_TO_FLUSH(logger);
+        setlocale(LC_NUMERIC, "C");
+        EXPECT_EQ(jsonSink.str, "{\"level\":\"I\",\"message\":\"locale\",\"ms\":1.5,\"ratio\":0.1}\n");
+        break;
+    }
+    logger.removeSink(&jsonSink);
+    logger.removeSink(&logfmtSink);
+}
+
+static std::string s_sanitizeTest(const std::string& str) {
+    std::string buffer;
+    blet::Logger::sanitize(buffer, str.data(), str.size());
+    return buffer;
+}
+
+GTEST_TEST(logger, sanitize) {
+    std::string clean;
+    for (int i = 0; i < 100; ++i) {
+        // printable ASCII without backslash
+        char c = static_cast<char>(' ' + i % 95);
+        clean.push_back(c != '\\' ? c : '/');
+    }
+    EXPECT_EQ(s_sanitizeTest(clean), clean);
+    EXPECT_EQ(s_sanitizeTest(""), "");
+    EXPECT_EQ(s_sanitizeTest("a\nb\rc\td\x1b[31me\x7f"), "a\\nb\\rc\\td\\x1b[31me\\x7f");
+    // an escaped message is not read as another
+    EXPECT_EQ(s_sanitizeTest("a\\nb\\"), "a\\\\nb\\\\");
+    EXPECT_NE(s_sanitizeTest("a\\n"), s_sanitizeTest("a\n"));
+    // valid UTF-8
+    EXPECT_EQ(s_sanitizeTest("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"), "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+    // invalid, truncated, overlong and surrogate sequences
+    EXPECT_EQ(s_sanitizeTest("\xff-\xc3"), "\\xff-\\xc3");
+    EXPECT_EQ(s_sanitizeTest("\xc0\x80"), "\\xc0\\x80");
+    EXPECT_EQ(s_sanitizeTest("\xed\xa0\x80"), "\\xed\\xa0\\x80");
+    EXPECT_EQ(s_sanitizeTest("\xf4\x90\x80\x80"), "\\xf4\\x90\\x80\\x80");
+    // unclean bytes at each position of the blocks
+    for (std::size_t i = 0; i < clean.size(); ++i) {
+        std::string str(clean);
+        str[i] = '\n';
+        std::string expected(clean.substr(0, i) + "\\n" + clean.substr(i + 1));
+        EXPECT_EQ(s_sanitizeTest(str), expected);
+        str[i] = '\\';
+        expected = clean.substr(0, i) + "\\\\" + clean.substr(i + 1);
+        EXPECT_EQ(s_sanitizeTest(str), expected);
+    }
+
+    blet::Logger logger;
+    StringSinkTest sink;
+    logger.setFILE(NULL);
+    logger.addSink(&sink, blet::Logger::DEBUG, "{message:%-8s}|{message:%8s}|");
+    EXPECT_FALSE(logger.isSanitized());
+    LOGGER_TO_INFO(logger, "a\nb");
+    // the messages are rendered by the logger thread
+    LOGGER_TO_FLUSH(logger);
+    logger.setSanitize(true);
+    EXPECT_TRUE(logger.isSanitized());
+    LOGGER_TO_INFO(logger, "a\nb");
+    LOGGER_TO_FLUSH(logger);
+    logger.removeSink(&sink);
+    EXPECT_EQ(sink.str, "a\nb     |     a\nb|\na\\nb    |    a\\nb|\n");
+}
+
+static void* s_threadBackendTest(void* e) {
+    blet::Logger** loggers = static_cast<blet::Logger**>(e);
+    for (int i = 0; i < 1000; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            blet::Logger& logger = *loggers[j];
+            LOGGER_TO_INFO(logger, "%d", i);
+        }
+    }
+    return NULL;
+}
+
+GTEST_TEST(logger, backend) {
+    blet::Logger::Backend backend(2);
+    EXPECT_EQ(backend.getThreadCount(), 2u);
+    blet::Logger* loggers[5];
+    StringSinkTest sinks[5];
+    for (int i = 0; i < 5; ++i) {
+        loggers[i] = new blet::Logger(&backend);
+        loggers[i]->setFILE(NULL);
+        loggers[i]->setAllFormat("{message}");
+        loggers[i]->addSink(&sinks[i]);
+    }
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, &s_threadBackendTest, loggers);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+        loggers[i]->flush();
+        EXPECT_EQ(std::count(sinks[i].str.begin(), sinks[i].str.end(), '\n'), 4 * 1000);
+    }
+    // the destructor writes the last messages
+    blet::Logger& last = *loggers[4];
+    LOGGER_TO_INFO(last, "last");
+    for (int i = 0; i < 5; ++i) {
+        delete loggers[i];
+    }
+    EXPECT_EQ(std::count(sinks[4].str.begin(), sinks[4].str.end(), '\n'), 4 * 1000 + 1);
+    EXPECT_EQ(sinks[4].str.substr(sinks[4].str.size() - 5), "last\n");
+}
+
+GTEST_TEST(logger, backendRecreate) {
+    blet::Logger::Backend backend(1);
+    for (int i = 0; i < 4; ++i) {
+        // a new logger may reuse the address of the previous one, not its ring
+        blet::Logger* logger = new blet::Logger(&backend);
+        logger->setFILE(NULL);
+        logger->setAllFormat("{message}");
+        StringSinkTest sink;
+        logger->addSink(&sink);
+        blet::Logger& ref = *logger;
+        LOGGER_TO_INFO(ref, "logger %d", i);
+        unsigned long ticket = logger->flushAsync();
+        logger->flush();
+        EXPECT_TRUE(logger->isFlushed(ticket));
+        // created after the write of ticket and readable
+        struct pollfd pfd;
+        pfd.fd = logger->getFlushFd();
+        pfd.events = POLLIN;
+        EXPECT_EQ(poll(&pfd, 1, 0), 1);
+        EXPECT_EQ(logger->getFlushFd(), pfd.fd);
+        EXPECT_EQ(sink.str, "logger " + std::to_string(i) + "\n");
+        logger->removeSink(&sink);
+        delete logger;
+    }
+}
+
+static pid_t s_findThreadTest(const char* name) {
+    DIR* dir = opendir("/proc/self/task");
+    pid_t tid = 0;
+    struct dirent* entry;
+    while (tid == 0 && (entry = readdir(dir)) != NULL) {
+        std::string path = std::string("/proc/self/task/") + entry->d_name + "/comm";
+        std::ifstream file(path.c_str());
+        std::string comm;
+        if (std::getline(file, comm) && comm == name) {
+            tid = atoi(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return tid;
+}
+
+GTEST_TEST(logger, threadPlacement) {
+    blet::Logger logger;
+    logger.setThreadName("blet-test-thread-name");
+    pid_t tid = s_findThreadTest("blet-test-threa");
+    ASSERT_NE(tid, 0);
+    std::vector<int> cpus(1, 0);
+    logger.setThreadAffinity(cpus);
+    cpu_set_t cpuSet;
+    ASSERT_EQ(sched_getaffinity(tid, sizeof(cpuSet), &cpuSet), 0);
+    EXPECT_EQ(CPU_COUNT(&cpuSet), 1);
+    EXPECT_TRUE(CPU_ISSET(0, &cpuSet));
+    logger.setThreadPriority(SCHED_OTHER, 5);
+    EXPECT_EQ(getpriority(PRIO_PROCESS, static_cast<id_t>(tid)), 5);
+    // the process is not changed
+    EXPECT_NE(getpriority(PRIO_PROCESS, 0), 5);
+
+    blet::Logger::Backend backend(2);
+    backend.setThreadName("blet-backend");
+    EXPECT_NE(s_findThreadTest("blet-backend-0"), 0);
+    EXPECT_NE(s_findThreadTest("blet-backend-1"), 0);
+    backend.setThreadAffinity(cpus);
+    blet::Logger shared(&backend);
+    EXPECT_THROW(shared.setThreadName("shared"), blet::Logger::Exception);
+}
+
+class BlockedSinkTest: public blet::Logger::Sink {
+  public:
+    BlockedSinkTest() :
+        isBlocked(false) {}
+
+    void write(const char* /*data*/, std::size_t /*size*/) {
+        __atomic_store_n(&isBlocked, true, __ATOMIC_RELEASE);
+        sleep(10);
+    }
+
+    bool isBlocked;
+};
+
+static void s_crashBlockedTest() {
+    blet::Logger logger;
+    logger.setName("crash");
+    logger.setFILE(NULL);
+    BlockedSinkTest sink;
+    logger.addSink(&sink);
+    logger.setCrashFlush(STDERR_FILENO, 10000000);
+    LOGGER_TO_INFO(logger, "first");
+    while (!__atomic_load_n(&sink.isBlocked, __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    // the logger thread is blocked, the queued messages are written by the signal handler
+    LOGGER_TO_ERR(logger, "context %d %s %5.2f %.*f %.1s %.0f", -42, "abc", 1.5, 3, 0.25, "xyz", 0.99);
+    abort();
+}
+
+static void s_crashTest() {
+    blet::Logger logger;
+    logger.setFILE(stderr);
+    logger.setAllFormat("<{level}> {message}");
+    logger.setBatchDelay(10000);
+    logger.setCrashFlush(STDERR_FILENO, 1000000000);
+    LOGGER_TO_INFO(logger, "healthy %d", 1);
+    abort();
+}
+
+GTEST_TEST(logger, crashFlush) {
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    // written by the logger thread
+    EXPECT_EXIT(s_crashTest(), testing::KilledBySignal(SIGABRT), "<INFO> healthy 1");
+    EXPECT_EXIT(s_crashBlockedTest(), testing::KilledBySignal(SIGABRT),
+                "crash:ERROR: .*mainLogger.cpp:[0-9]+ context -42 abc 1.50 0.250 x 1\n");
+}
+
+static void* s_threadRenameTest(void* e) {
+    blet::Logger& logger = *static_cast<blet::Logger*>(e);
+    for (int i = 0; i < 1000; ++i) {
+        LOGGER_TO_INFO(logger, "%d", i);
+    }
+    return NULL;
+}
+
+GTEST_TEST(logger, renameDuringTraffic) {
+    blet::Logger logger;
+    logger.setFILE(NULL);
+    StringSinkTest sink;
+    logger.addSink(&sink, blet::Logger::DEBUG, "{name}:{message}");
+    pthread_t thread;
+    pthread_create(&thread, NULL, &s_threadRenameTest, &logger);
+    // the logger thread renders with its copies of the formats
+    for (int i = 0; i < 100; ++i) {
+        logger.setName((i % 2 == 0) ? "even" : "odd");
+        logger.setAllFormat("{name} {message}");
+    }
+    pthread_join(thread, NULL);
+    logger.setName("last");
+    EXPECT_EQ(logger.getName(), "last");
+    LOGGER_TO_INFO(logger, "end");
+    logger.flush();
+    EXPECT_EQ(std::count(sink.str.begin(), sink.str.end(), '\n'), 1001);
+    EXPECT_EQ(sink.str.substr(sink.str.size() - 9), "last:end\n");
+    logger.removeSink(&sink);
+}
+
+GTEST_TEST(logger, bigmessage) {
+    LOGGER_MAIN().setAllFormat("{message}");
+    std::string bigMessage(LOGGER_MESSAGE_MAX_SIZE * 4, 'x');
+    testing::internal::CaptureStdout();
+    std::ostringstream oss("");
+    for (int i = 0; i < 100; ++i) {
+        LOGGER_DEBUG("%s", bigMessage.c_str());
+        LOGGER_DEBUG("test");
+        oss << bigMessage << "\ntest\n";
+    }
+    LOGGER_FLUSH();
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, oss.str());
+}
+
+__attribute__((noinline)) static void s_clobberStackTest() {
+    volatile char stack[256];
+    for (std::size_t i = 0; i < sizeof(stack); ++i) {
+        stack[i] = 'x';
+    }
+}
+
+static void s_localFormatTest(blet::Logger& logger) {
+    char format[32];
+    strcpy(format, "value=%d");
+    // not a string literal, formated before the return
+    LOGGER_TO_INFO(logger, format, 42);
+}
+
+GTEST_TEST(logger, deferredLocalFormat) {
+    blet::Logger logger;
+    logger.setFILE(NULL);
+    logger.setAllFormat("{message}");
+    StringSinkTest sink;
+    logger.addSink(&sink);
+    s_localFormatTest(logger);
+    // overwrite the stack of format
+    s_clobberStackTest();
+    logger.flush();
+    EXPECT_EQ(sink.str, "value=42\n");
+    logger.removeSink(&sink);
+}
+
+GTEST_TEST(logger, syncLog) {
+    blet::Logger logger;
+    logger.setFILE(NULL);
+    logger.setAllFormat("{message}");
+    StringSinkTest sink;
+    logger.addSink(&sink);
+    std::string bigString(LOGGER_MESSAGE_MAX_SIZE * 2, 'x');
+    LOGGER_LOG(logger, blet::Logger::INFO, "sync %d", 1);
+    // written by the sinks before the return
+    EXPECT_EQ(sink.str, "sync 1\n");
+    LOGGER_LOG(logger, blet::Logger::INFO, "%s", bigString.c_str());
+    EXPECT_EQ(sink.str, "sync 1\n" + bigString + "\n");
+    logger.removeSink(&sink);
+}
+
+GTEST_TEST(logger, deferredArguments) {
+    LOGGER_MAIN().setAllFormat("{message}");
+    testing::internal::CaptureStdout();
+    char str[16] = "foo";
+    std::string bigString(LOGGER_MESSAGE_MAX_SIZE * 2, 'x');
+    LOGGER_DEBUG("%d %u %ld %c %.2f %s %s 100%%", -42, 42u, 42l, 'c', 4.2, str, "bar");
+    // string arguments are copied
+    str[0] = 'b';
+    LOGGER_DEBUG("%s", str);
+    LOGGER_DEBUG("%s", bigString.c_str());
+    LOGGER_FLUSH();
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "-42 42 42 c 4.20 foo bar 100%\nboo\n" + bigString + "\n");
+}
+
+static int s_evaluationCount = 0;
+
+static int s_evaluate() {
+    return ++s_evaluationCount;
+}
+
+GTEST_TEST(logger, level) {
+    LOGGER_MAIN().setAllFormat("{message}");
+    testing::internal::CaptureStdout();
+    s_evaluationCount = 0;
+    LOGGER_SET_LEVEL(blet::Logger::WARNING);
+    EXPECT_EQ(LOGGER_MAIN().getLevel(), blet::Logger::WARNING);
+    LOGGER_DEBUG("debug %d", s_evaluate());
+    LOGGER_INFO("info %d", s_evaluate());
+    LOGGER_WARN("warning %d", s_evaluate());
+    LOGGER_ERROR("error %d", s_evaluate());
+    LOGGER_SET_LEVEL(blet::Logger::DEBUG);
+    LOGGER_DEBUG("debug %d", s_evaluate());
+    LOGGER_FLUSH();
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(s_evaluationCount, 3);
+    EXPECT_EQ(output, "warning 1\nerror 2\ndebug 3\n");
+}
+
+GTEST_TEST(logger, format) {
+    blet::Logger logger;
+    logger.setName("foo");
+    logger.setAllFormat("{name:[%-5s]} {level:%6s} {file}:{line:%05d} {line:%-4d|} {line:%+d} {pid:%x} {func} "
+                        "{message:%.4s} \\{message\\}");
+    testing::internal::CaptureStdout();
+    int line = __LINE__ + 1;
+    LOGGER_TO_WARN(logger, "message");
+    LOGGER_TO_FLUSH(logger);
+    std::string output = testing::internal::GetCapturedStdout();
+    char expected[256];
+    snprintf(expected, sizeof(expected), "[foo  ]   WARN mainLogger.cpp:%05d %-4d| %+d %x %s mess {message}\n", line,
+             line, line, getpid(), __func__);
+    EXPECT_EQ(output, expected);
+}
+
+GTEST_TEST(logger, time) {
+    static const char* const timezones[] = {"UTC0", "CET-1CEST,M3.5.0,M10.5.0/3", "NST3:30NDT,M3.2.0,M11.1.0",
+                                            "<+1245>-12:45<+1345>,M9.5.0/2:45,M4.1.0/3:45"};
+    std::string oldTz = getenv("TZ") ? getenv("TZ") : "";
+    blet::Logger logger;
+    logger.setAllFormat("{time:%Y-%m-%d %H:%M:%S %j %a %z %Z}|{time:%T}|{time:iso8601.3}");
+    blet::Logger::Message message;
+    message.level = blet::Logger::INFO;
+    message.file = "";
+    message.filename = "";
+    message.line = 0;
+    message.function = "";
+    message.message = "";
+    for (std::size_t i = 0; i < sizeof(timezones) / sizeof(*timezones); ++i) {
+        setenv("TZ", timezones[i], 1);
+        tzset();
+        for (time_t t = -86400 * 365; t < 86400 * 365 * 60; t += 86400 * 17 + 3623) {
+            message.ts.tv_sec = t;
+            message.ts.tv_nsec = 123456789;
+            testing::internal::CaptureStdout();
+            logger.printMessage(message);
+            fflush(stdout);
+            std::string output = testing::internal::GetCapturedStdout();
+            struct tm tm;
+            localtime_r(&t, &tm);
+            char expected[256];
+            char isoOffset[8];
+            strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S %j %a %z %Z|%T|%Y-%m-%dT%H:%M:%S.123", &tm);
+            strftime(isoOffset, sizeof(isoOffset), "%z", &tm);
+            std::string iso(isoOffset);
+            iso.insert(3, ":");
+            ASSERT_EQ(output, std::string(expected) + iso + "\n") << timezones[i] << " " << t;
+        }
+    }
+    setenv("TZ", oldTz.c_str(), 1);
+    tzset();
+}
+
+GTEST_TEST(logger, utctime) {
+    blet::Logger logger;
+    logger.setAllFormat("{utctime:%s} {utctime:%Y-%m-%d %H:%M:%S}|{utctime:iso8601}");
+    testing::internal::CaptureStdout();
+    for (int i = 0; i < 100; ++i) {
+        LOGGER_TO_INFO(logger, "%s", "");
+    }
+    LOGGER_TO_FLUSH(logger);
+    std::istringstream output(testing::internal::GetCapturedStdout());
+    std::string line;
+    int count = 0;
+    while (std::getline(output, line)) {
+        time_t t = static_cast<time_t>(atol(line.c_str()));
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char expected[128];
+        strftime(expected, sizeof(expected), " %Y-%m-%d %H:%M:%S|%Y-%m-%dT%H:%M:%SZ", &tm);
+        EXPECT_EQ(line.substr(line.find(' ')), expected);
+        ++count;
+    }
+    EXPECT_EQ(count, 100);
+}
+
+GTEST_TEST(logger, clock) {
+    const blet::Logger::eClock clocks[] = {blet::Logger::REALTIME_CLOCK, blet::Logger::REALTIME_COARSE_CLOCK,
+                                           blet::Logger::MONOTONIC_RAW_CLOCK, blet::Logger::TSC_CLOCK};
+    blet::Logger logger;
+    logger.setAllFormat("{time:%s}.{nanosec}");
+    for (size_t i = 0; i < sizeof(clocks) / sizeof(*clocks); ++i) {
+        try {
+            logger.setClock(clocks[i]);
+        }
+        catch (const blet::Logger::Exception& e) {
+            // time stamp counter not invariant
+            continue;
+        }
+        EXPECT_EQ(logger.getClock(), clocks[i]);
+        EXPECT_GE(logger.getClockError(), 0);
+        struct timespec before;
+        struct timespec after;
+        testing::internal::CaptureStdout();
+        clock_gettime(CLOCK_REALTIME, &before);
+        LOGGER_TO_INFO(logger, "%s", "");
+        clock_gettime(CLOCK_REALTIME, &after);
+        LOGGER_TO_FLUSH(logger);
+        std::string output = testing::internal::GetCapturedStdout();
+        long long sec = atoll(output.c_str());
+        long long nsec = atoll(output.c_str() + output.find('.') + 1);
+        long long stamp = sec * 1000000000LL + nsec;
+        // coarse clock is in late of one tick
+        long long margin = logger.getClockError() + 10000000LL;
+        EXPECT_GE(stamp, before.tv_sec * 1000000000LL + before.tv_nsec - margin) << i;
+        EXPECT_LE(stamp, after.tv_sec * 1000000000LL + after.tv_nsec + margin) << i;
+    }
+}
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+
+#define LOGGER_MIN_LEVEL LOG_INFO
+#include "blet/logger.h"
+
+static std::size_t s_countInExecutable(const char* str) {
+    std::ifstream ifs("/proc/self/exe", std::ios::binary);
+    std::string executable((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::size_t count = 0;
+    std::size_t index = executable.find(str);
+    while (index != std::string::npos) {
+        ++count;
+        index = executable.find(str, index + 1);
+    }
+    return count;
+}
+
+GTEST_TEST(logger, minLevel) {
+    blet::Logger logger;
+    logger.setAllFormat("{message}");
+    testing::internal::CaptureStdout();
+    LOGGER_TO_DEBUG(logger, "MIN_LEVEL_DEBUG_%s", "TO_MARKER");
+    LOGGER_DEBUG("MIN_LEVEL_DEBUG_%s", "MARKER");
+    LOGGER_TO_INFO(logger, "MIN_LEVEL_INFO_%s", "TO_MARKER");
+    LOGGER_TO_FLUSH(logger);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "MIN_LEVEL_INFO_TO_MARKER\n");
+
+    // build the searched strings at runtime
+    std::string debugFormat("_IN_LEVEL_DEBUG_%s");
+    std::string infoFormat("_IN_LEVEL_INFO_%s");
+    debugFormat[0] = 'M';
+    infoFormat[0] = 'M';
+    EXPECT_EQ(s_countInExecutable(debugFormat.c_str()), 0u);
+    EXPECT_EQ(s_countInExecutable(infoFormat.c_str()), 1u);
+}
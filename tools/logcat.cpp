@@ -0,0 +1,135 @@
+/**
+ * logcat.cpp
+ * Print the binary stream of Logger::addBinarySink as text.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "blet/logger.h"
+
+static void s_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-l LEVEL] [-s SECONDS] [-e SECONDS] [-n NAME] [-f FORMAT] [FILE...]\n"
+            "  -l LEVEL    print the messages of LEVEL and more critical (EMERG..DEBUG or 0..7)\n"
+            "  -s SECONDS  print the messages since this epoch time\n"
+            "  -e SECONDS  print the messages until this epoch time\n"
+            "  -n NAME     print the messages of logger NAME\n"
+            "  -f FORMAT   format of messages (keywords of Logger::setAllFormat)\n"
+            "Read the standard input without FILE.\n",
+            program);
+}
+
+static bool s_parseLevel(const char* str, blet::Logger::eLevel& level) {
+    static const char* names[] = {"EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"};
+    for (int i = 0; i < 8; ++i) {
+        if (strcasecmp(str, names[i]) == 0 || (str[0] == '0' + i && str[1] == '\0')) {
+            level = static_cast<blet::Logger::eLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool s_parseTime(const char* str, int64_t& stamp) {
+    char* end = NULL;
+    double seconds = strtod(str, &end);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    stamp = static_cast<int64_t>(seconds * 1000000000.0);
+    return true;
+}
+
+struct Filter {
+    blet::Logger::eLevel level;
+    int64_t since;
+    int64_t until;
+    const char* name;
+};
+
+static void s_cat(blet::Logger& logger, FILE* file, const Filter& filter) {
+    blet::Logger::BinaryReader reader(file);
+    blet::Logger::Message message;
+    while (reader.next(message)) {
+        int64_t stamp = static_cast<int64_t>(message.ts.tv_sec) * 1000000000 + message.ts.tv_nsec;
+        if (message.level > filter.level || stamp < filter.since || stamp > filter.until ||
+            (filter.name != NULL && reader.getName() != filter.name)) {
+            continue;
+        }
+        if (logger.getName() != reader.getName()) {
+            logger.setName(reader.getName().c_str());
+        }
+        logger.printMessage(message);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Filter filter;
+    filter.level = blet::Logger::DEBUG;
+    filter.since = INT64_MIN;
+    filter.until = INT64_MAX;
+    filter.name = NULL;
+    const char* format = "{time:iso8601.9} {name}:{level:%-6s}: {path}:{line} {message}";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:e:n:f:h")) != -1) {
+        bool isValid = true;
+        switch (opt) {
+            case 'l':
+                isValid = s_parseLevel(optarg, filter.level);
+                break;
+            case 's':
+                isValid = s_parseTime(optarg, filter.since);
+                break;
+            case 'e':
+                isValid = s_parseTime(optarg, filter.until);
+                break;
+            case 'n':
+                filter.name = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            default:
+                isValid = false;
+                break;
+        }
+        if (!isValid) {
+            s_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // the messages are printed by printMessage without the logger thread
+    blet::Logger logger;
+    logger.setAllFormat(format);
+    int ret = 0;
+    try {
+        if (optind >= argc) {
+            s_cat(logger, stdin, filter);
+        }
+        for (int i = optind; i < argc; ++i) {
+            FILE* file = fopen(argv[i], "rb");
+            if (file == NULL) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], argv[i], strerror(errno));
+                ret = 1;
+                continue;
+            }
+            s_cat(logger, file, filter);
+            fclose(file);
+        }
+    }
+    catch (const blet::Logger::Exception& e) {
+        fprintf(stderr, "%s: %s\n", argv[0], e.what());
+        ret = 1;
+    }
+    return ret;
+}
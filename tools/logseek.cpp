@@ -0,0 +1,150 @@
+/**
+ * logseek.cpp
+ * Print the blocks of a log file selected by its FileIndex (path.idx).
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "blet/logger.h"
+
+static void s_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-l LEVEL] [-s SECONDS] [-e SECONDS] [-b] FILE\n"
+            "  -l LEVEL    print the blocks with a message of LEVEL or more critical (EMERG..DEBUG or 0..7)\n"
+            "  -s SECONDS  print the blocks with messages since this epoch time\n"
+            "  -e SECONDS  print the blocks with messages until this epoch time\n"
+            "  -b          print the offset, size and time range of blocks instead of their messages\n"
+            "The messages written after the last block of index are always printed.\n",
+            program);
+}
+
+static bool s_parseLevel(const char* str, blet::Logger::eLevel& level) {
+    static const char* names[] = {"EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"};
+    for (int i = 0; i < 8; ++i) {
+        if (strcasecmp(str, names[i]) == 0 || (str[0] == '0' + i && str[1] == '\0')) {
+            level = static_cast<blet::Logger::eLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool s_parseTime(const char* str, int64_t& stamp) {
+    char* end = NULL;
+    double seconds = strtod(str, &end);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    stamp = static_cast<int64_t>(seconds * 1000000000.0);
+    return true;
+}
+
+static bool s_copy(FILE* file, uint64_t offset, uint64_t size) {
+    if (fseeko(file, static_cast<off_t>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+    char buffer[65536];
+    while (size > 0) {
+        std::size_t chunk = (size < sizeof(buffer)) ? static_cast<std::size_t>(size) : sizeof(buffer);
+        chunk = fread(buffer, 1, chunk, file);
+        if (chunk == 0) {
+            break;
+        }
+        fwrite(buffer, 1, chunk, stdout);
+        size -= chunk;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    blet::Logger::eLevel level = blet::Logger::DEBUG;
+    int64_t since = INT64_MIN;
+    int64_t until = INT64_MAX;
+    bool isBlockPrinted = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:e:bh")) != -1) {
+        bool isValid = true;
+        switch (opt) {
+            case 'l':
+                isValid = s_parseLevel(optarg, level);
+                break;
+            case 's':
+                isValid = s_parseTime(optarg, since);
+                break;
+            case 'e':
+                isValid = s_parseTime(optarg, until);
+                break;
+            case 'b':
+                isBlockPrinted = true;
+                break;
+            default:
+                isValid = false;
+                break;
+        }
+        if (!isValid) {
+            s_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        s_usage(argv[0]);
+        return 2;
+    }
+    const char* path = argv[optind];
+
+    std::vector<blet::Logger::FileIndex::Block> blocks;
+    std::vector<blet::Logger::FileIndex::Block> found;
+    try {
+        blet::Logger::FileIndex::read(blet::Logger::FileIndex::getPath(path).c_str(), blocks);
+    }
+    catch (const blet::Logger::Exception& e) {
+        fprintf(stderr, "%s: %s\n", argv[0], e.what());
+        return 1;
+    }
+    blet::Logger::FileIndex::find(blocks, since, until, level, found);
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+        return 1;
+    }
+    // messages not indexed yet
+    uint64_t indexEnd = blocks.empty() ? 0 : blocks.back().offset + blocks.back().size;
+    fseeko(file, 0, SEEK_END);
+    uint64_t fileEnd = static_cast<uint64_t>(ftello(file));
+    if (fileEnd > indexEnd) {
+        blet::Logger::FileIndex::Block tail;
+        memset(&tail, 0, sizeof(tail));
+        tail.minStamp = INT64_MIN;
+        tail.maxStamp = INT64_MAX;
+        tail.offset = indexEnd;
+        tail.size = fileEnd - indexEnd;
+        tail.levels = 0xFF;
+        found.push_back(tail);
+    }
+    int ret = 0;
+    for (std::size_t i = 0; i < found.size(); ++i) {
+        if (isBlockPrinted) {
+            printf("%llu %llu %lld %lld 0x%02x\n", static_cast<unsigned long long>(found[i].offset),
+                   static_cast<unsigned long long>(found[i].size), static_cast<long long>(found[i].minStamp),
+                   static_cast<long long>(found[i].maxStamp), found[i].levels);
+        }
+        else if (!s_copy(file, found[i].offset, found[i].size)) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+            ret = 1;
+            break;
+        }
+    }
+    fclose(file);
+    return ret;
+}